@@ -4,19 +4,26 @@
  * the image into batches of rows, and creates a thread to process each seperated batch. Each thread applies the blur filter to its batch of rows 
  * by calculating the average value of a pixel (which was shown in the assignment task) and its surrounding pixels, and setting the value of the 
  * current pixel to the calculated average value. The program then writes the output image with the blur filter applied back to a file.
+ * An optional third argument --affinity=compact|scatter|0,2,8-11 pins the threads to cpus (compact fills one socket first, scatter spreads
+ * them over the sockets). Each thread copies the rows it reads and allocates the rows it writes itself, so they sit next to its cpu.
 */
 
 // To run code:
 
 //  gcc BlurAnImage.c -lm lodepng.c -lpthread -o BlurAnImage; 
 //  ./BlurAnImage 300 selfie.png; 
+//  ./BlurAnImage 300 selfie.png --affinity=scatter; 
 //  rm BlurAnImage
 
+// For sched_getaffinity and pthread_attr_setaffinity_np.
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lodepng.h"
 #include <math.h>
 #include <pthread.h>
+#include <sched.h>
 
 // Struct to store information needed for each thread to apply blur filter
 typedef struct
@@ -29,6 +36,139 @@ typedef struct
     unsigned char **blurred_image; // Blurred image
 } Parameter;
 
+/**
+ * Returns the socket (physical package) of a cpu from sysfs, or 0 if it can't be read.
+ */
+int cpu_socket(int cpu)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *file = fopen(path, "r");
+    int socket = 0;
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &socket) != 1)
+        {
+            socket = 0;
+        }
+        fclose(file);
+    }
+    return socket;
+}
+
+/**
+ * Fills 'cpus' with the cpu each thread gets pinned to for --affinity, thread i runs on cpus[i % count].
+ * "compact" uses every cpu of one socket before the next one, "scatter" takes one cpu from each socket in turn and
+ * a list such as "0,2,8-11" is used as it is. Returns the number of cpus, or -1 if the text is not valid or names a
+ * cpu this process isn't allowed to run on.
+ */
+int affinity_plan(const char *mode, int *cpus, int max)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return -1;
+    }
+    int count = 0;
+
+    if (strcmp(mode, "compact") == 0 || strcmp(mode, "scatter") == 0)
+    {
+        int socket[CPU_SETSIZE];
+        int rank[CPU_SETSIZE];
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus[count] = cpu;
+                socket[count] = cpu_socket(cpu);
+                // The rank is how many cpus of the same socket come before this one.
+                rank[count] = 0;
+                for (int j = 0; j < count; j++)
+                {
+                    rank[count] += socket[j] == socket[count];
+                }
+                count++;
+            }
+        }
+        // Insertion sort by socket (compact) or by rank then socket (scatter), keeping the cpu order for ties.
+        int scatter = strcmp(mode, "scatter") == 0;
+        for (int i = 1; i < count; i++)
+        {
+            int cpu = cpus[i];
+            int s = socket[i];
+            int r = rank[i];
+            int j = i - 1;
+            while (j >= 0 && (scatter ? (rank[j] > r || (rank[j] == r && socket[j] > s)) : socket[j] > s))
+            {
+                cpus[j + 1] = cpus[j];
+                socket[j + 1] = socket[j];
+                rank[j + 1] = rank[j];
+                j--;
+            }
+            cpus[j + 1] = cpu;
+            socket[j + 1] = s;
+            rank[j + 1] = r;
+        }
+        return count;
+    }
+
+    // Explicit list of cpus and ranges.
+    const char *text = mode;
+    while (*text != '\0')
+    {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+        if (end == text || first < 0)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || last < first)
+            {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == max || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+            {
+                return -1;
+            }
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end != '\0')
+        {
+            return -1;
+        }
+        text = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+/**
+ * Sets up the thread attributes so thread 'index' starts on its cpu. With no cpus the defaults are kept.
+ */
+void affinity_attr(pthread_attr_t *attr, const int *cpus, int count, int index)
+{
+    pthread_attr_init(attr);
+    if (count > 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[index % count], &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+}
+
 /**
  * This function applies a blur filter to an image. It does this by considering the current pixel and its
  * surrounding pixels(a 3x3 grid), calculating the average value of those pixels, and setting the value of
@@ -38,6 +178,18 @@ void *apply_blur_filter(void *p)
 {
     Parameter *param = (Parameter *)p;
 
+    /* First touch: copy the rows this batch reads (its own rows and the row above it) into memory this thread allocates,
+       and allocate the rows it writes here as well, so on a multi-socket machine they are placed on the socket running the thread.
+    */
+    int first_row = param->start > 0 ? param->start - 1 : 0;
+    size_t row_bytes = param->width * 4;
+    unsigned char *rows = malloc((param->end - first_row) * row_bytes);
+    memcpy(rows, param->image + first_row * row_bytes, (param->end - first_row) * row_bytes);
+    for (int row = param->start; row < param->end; row++)
+    {
+        param->blurred_image[row] = malloc(row_bytes);
+    }
+
     // Initialise the outer loop with param->start and end with param->end to ensure the threads don't use unauthorized rows form other threads.
     for (int row = param->start; row < param->end; row++)
     {
@@ -63,9 +215,9 @@ void *apply_blur_filter(void *p)
                     if (row + i >= 0 && row + i < param->end && col / 4 + j >= 0 && col / 4 + j < param->width)
                     {
                         // Add values of surrounding pixels to sum
-                        sumR += param->image[(row + i) * param->width * 4 + (col / 4 + j) * 4 + 0];
-                        sumG += param->image[(row + i) * param->width * 4 + (col / 4 + j) * 4 + 1];
-                        sumB += param->image[(row + i) * param->width * 4 + (col / 4 + j) * 4 + 2];
+                        sumR += rows[(row + i - first_row) * row_bytes + (col / 4 + j) * 4 + 0];
+                        sumG += rows[(row + i - first_row) * row_bytes + (col / 4 + j) * 4 + 1];
+                        sumB += rows[(row + i - first_row) * row_bytes + (col / 4 + j) * 4 + 2];
                         // For each pixel used the count will increment itself.
                         count++;
                     }
@@ -82,7 +234,7 @@ void *apply_blur_filter(void *p)
             param->blurred_image[row][col] = sumR / count;
             param->blurred_image[row][col + 1] = sumG / count;
             param->blurred_image[row][col + 2] = sumB / count;
-            param->blurred_image[row][col + 3] = param->image[row * param->width * 4 + col + 3];
+            param->blurred_image[row][col + 3] = rows[(row - first_row) * row_bytes + col + 3];
 
             // print out the pixel values for testing purposes.
             //printf("Batch num: %d\tR: %d\tG:%d\tB:%d\n", param->batch, param->blurred_image[row][col_pos], param->blurred_image[row][col_pos + 1], param->blurred_image[row][col_pos + 2]);
@@ -92,16 +244,33 @@ void *apply_blur_filter(void *p)
             //After the current pixel is 'Averaged', the loop will go to the next pixel.
         }
     }
+    free(rows);
+    return NULL;
 }
 
 int main(int argc, char *argv[])
 {
     // Check if correct number of arguments are provided, if not an error message is printed.
-    if (argc != 3)
+    if (argc != 3 && argc != 4)
     {
-        printf("Usage: ./program_name input_image.png num_threads\n");
+        printf("Usage: ./program_name num_threads input_image.png [--affinity=compact|scatter|0,2,8-11]\n");
         return EXIT_FAILURE;
     }
+    // Optional cpu pinning for the threads.
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    if (argc == 4)
+    {
+        if (strncmp(argv[3], "--affinity=", 11) == 0)
+        {
+            cpu_count = affinity_plan(argv[3] + 11, cpus, CPU_SETSIZE);
+        }
+        if (cpu_count <= 0)
+        {
+            printf("--affinity takes compact, scatter or a list of cpus this process can use such as 0,2,8-11\n");
+            return EXIT_FAILURE;
+        }
+    }
     // Convert number of threads input to int
     int num_threads = atoi(argv[1]);
 
@@ -126,11 +295,8 @@ int main(int argc, char *argv[])
     else
     {
         // Create a new 2D array to store the blurred image. This is used for multi threads.
+        // Only the row pointers are allocated here, each thread allocates the rows of its own batch.
         unsigned char **blurred_image = malloc(height * sizeof(unsigned char *));
-        for (int i = 0; i < height; i++)
-        {
-            blurred_image[i] = malloc(width * 4 * sizeof(unsigned char));
-        }
 
         // Create a new 2D array to store the complete blurred image. This is used to reconstruct the image from each threads.
         unsigned char **complete_blurred_image = malloc(height * sizeof(unsigned char *));
@@ -173,8 +339,11 @@ int main(int argc, char *argv[])
             param[i].width = width;
             param[i].blurred_image = blurred_image;
 
-            // Create thread and apply blur filter to designated batch of image
-            pthread_create(thread + i, NULL, apply_blur_filter, (void *)&param[i]);
+            // Create thread and apply blur filter to designated batch of image, pinned to its cpu if --affinity was given.
+            pthread_attr_t attr;
+            affinity_attr(&attr, cpus, cpu_count, i);
+            pthread_create(thread + i, &attr, apply_blur_filter, (void *)&param[i]);
+            pthread_attr_destroy(&attr);
 
             // Update start row for next batch
             start = end_row;
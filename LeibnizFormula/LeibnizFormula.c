@@ -1,137 +1,3358 @@
 /*LeibnizFormula:
 This program calculates Pi using the Leibniz formula. It reads in user inputs from the command line and creates threads to perform the calculations.
+The batching and thread pool work for any series, so --series=nilakantha, --series=machin or --series=chudnovsky (normalised binary
+splitting) run through the same code, and --series-bench runs all of them to compare how many digits per second each gets.
 The program gets the number of iterations and number of batches( for multi threading) and stores them in variables.
+The batches are handed out to a fixed pool of threads (one per CPU, or --threads=N), so the number of batches only sets how
+finely the work is split and not how many threads get created. Every thread starts with an equal share of the batches in its
+own deque and steals from the others once it runs out, so with many more batches than threads a slow core does not hold up
+the run. The number of batches each thread ran (and stole) is printed at the end.
+The terms and batches can be added with a plain sum, a compensated (Neumaier) sum or a pairwise sum (--sum=naive|neumaier|pairwise),
+and --sum-bench runs all three and prints the time and error of each.
+The plain series only gains one digit for every 10x more terms, so the partial sums can be accelerated with --accel=euler
+(Euler-van Wijngaarden transform of the remaining terms), --accel=aitken or --accel=richardson. --digits=N sets how many
+decimals are printed.
+With --tolerance=T the iterations become an upper limit: batches are handed out in order and no more are handed out once
+the alternating series error bound 4 / (2n + 1) is below T, so the run stops as soon as the answer is good enough.
+A double only holds about 15 digits, so --precision=long, --precision=quad or --precision=fixed sum every batch in long double,
+__float128 or a built-in fixed-point big number (sized from --digits) and add the batches together with a parallel tree
+reduction. This is much slower per term, and only --accel=euler works with it, but combined they give as many digits as asked for.
+--bench (CSV) or --bench=json sweeps thread counts and iteration sizes (--bench-threads=1,2,4 and --bench-sizes=1e8,1e9, by default
+1, 2, 4, ... CPUs and N/100, N/10, N) and prints the terms per second, speedup and parallel efficiency of each run.
+--affinity=compact|scatter|0,2,8-11 pins every pool thread to a CPU: compact fills one socket first, scatter spreads the threads
+over the sockets and a list is used as given. Each worker allocates the big-number sums of the batches it claims itself, so that
+memory is placed on its own socket.
+--progress prints how many terms have been summed while the threads run. Each worker writes its progress into its own
+cache line sized slot, so the updates in the hot loop do not slow the other cores down.
+Each batch is only given the start and end of its range of iterations, so memory use does not grow with the number of iterations.
+All iteration counts and ranges are 64-bit, so runs past 2^31 terms work and the iterations can be written as 1e12.
+The terms are summed by a kernel which can be chosen with --kernel=scalar or --kernel=simd (default simd). The simd kernel
+picks AVX-512 or AVX2 at runtime depending on what the CPU supports and falls back to the scalar kernel otherwise.
+--kernel-check (no iterations or batches needed) sums more than 2^20 terms of every series with each SIMD kernel the CPU has and
+with the scalar kernel, and exits with 1 if a SIMD kernel is less accurate than the scalar one.
+--pi-digits=N (no iterations or batches needed) works out N digits of Pi, up to 30 million, with the Chudnovsky series on
+built-in big integers and writes them to PiDigits.txt (or --output=FILE). The binary splitting of the series is a tree of
+products whose subtrees are handed out on a work-stealing pool of --threads threads, long products use a number theoretic
+transform, and the numbers are stored in base 10^9 so the digits are streamed to the file without converting them.
 
 To run code:
     gcc LeibnizFormula.c -pthread -lm -o LeibnizFormula;
     ./LeibnizFormula 9999 4000;
+    ./LeibnizFormula 9999 4000 --kernel=scalar;
+    ./LeibnizFormula 1e10 64;
+    ./LeibnizFormula 1e9 64 --sum-bench;
+    ./LeibnizFormula 1e5 64 --accel=euler --digits=15;
+    ./LeibnizFormula 1e12 100000 --tolerance=1e-7;
+    ./LeibnizFormula 1e4 64 --precision=fixed --accel=euler --digits=200;
+    ./LeibnizFormula 1e10 4000 --bench=json --bench-threads=1,2,4,8;
+    ./LeibnizFormula 1e6 64 --series-bench;
+    ./LeibnizFormula --pi-digits=1e6 --output=PiDigits.txt;
+    ./LeibnizFormula --kernel-check;
+    ./LeibnizFormula 1e10 64 --affinity=scatter;
     rm LeibnizFormula
 */
 
+// For sched_getaffinity and pthread_attr_setaffinity_np.
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+#include <immintrin.h>
 
+// Number of terms the kernel adds with a plain sum before the result is passed to the compensated or pairwise sum.
+#define SUM_BLOCK 1024
+
+// A kernel returns the sum of the terms of a series for every i in [start, end), for Leibniz (-1)^i / (2i + 1).
+typedef double (*SeriesKernel)(long long start, long long end);
+
+/* A series that Pi can be worked out from. Each batch sums its range of terms with one of the kernels and multiplies by 'scale',
+   then 'finish' turns the total of every batch into Pi. 'errorBound' is how far Pi can still be off after the first n terms,
+   which the target-precision mode uses. A SIMD kernel left as NULL falls back to the scalar one.
+*/
+typedef struct
+{
+    const char *name;
+    SeriesKernel scalar;
+    SeriesKernel avx2;
+    SeriesKernel avx512;
+    double scale;
+    double (*finish)(double total);
+    double (*errorBound)(long long n);
+} Series;
+
+// How the terms inside a batch, and then the batches themselves, are added together.
+typedef enum
+{
+    SUM_NAIVE,    // Plain running sum.
+    SUM_NEUMAIER, // Compensated sum (Kahan-Babuska-Neumaier).
+    SUM_PAIRWISE  // Pairwise sum, the range is halved recursively and the halves are added.
+} SumMode;
+
+// Optional acceleration applied to the partial sums once every batch is done.
+typedef enum
+{
+    ACCEL_NONE,      // Just the partial sum.
+    ACCEL_EULER,     // Euler-van Wijngaarden transform of the remaining terms.
+    ACCEL_AITKEN,    // Iterated Aitken delta-squared on the last few partial sums.
+    ACCEL_RICHARDSON // Richardson extrapolation on partial sums at N, N/2, N/4, ...
+} AccelMode;
+
+// Number type used to add up the terms. Everything except PREC_DOUBLE trades speed for more correct digits.
+typedef enum
+{
+    PREC_DOUBLE,      // double with the SIMD kernels, about 15 digits.
+    PREC_LONG_DOUBLE, // x87 long double, about 18 digits.
+    PREC_QUAD,        // __float128, about 33 digits.
+    PREC_FIXED        // FixedNum, as many digits as asked for.
+} Precision;
+
+/* Fixed-point big number. limb[0] is the integer part and limb[1] to limb[count - 1] are the fraction, most significant first,
+   so the value is the limbs read as one big integer divided by 2^(32 * (count - 1)). Negative values wrap around (two's complement),
+   which is fine here because only the final sum has to be positive.
+*/
+typedef struct
+{
+    uint32_t *limb;
+    int count;
+} FixedNum;
+
+// Number of times the Aitken delta-squared step is repeated, it uses 2 * AITKEN_LEVELS + 1 partial sums.
+#define AITKEN_LEVELS 3
+// Number of partial sums (at N, N/2, N/4, ...) used for Richardson extrapolation.
+#define RICHARDSON_LEVELS 5
+
+// Size of a cache line. Data written by different threads is kept on separate lines so the cores do not keep stealing the line from each other.
+#define CACHE_LINE 64
+// Number of terms between progress updates when using the plain sum.
+#define PROGRESS_BLOCK (1 << 20)
+
+typedef struct WorkerSlot WorkerSlot;
+
+/* A batch only needs to know the range of i it covers, the terms themselves are worked out from i.
+   Each batch is aligned to its own cache line, so two workers finishing neighbouring batches never write to the same line.
+*/
+typedef struct
+{
+    _Alignas(CACHE_LINE) int batch;
+    double pi;        // 4 * the sum of the batch.
+    double piError;   // Rounding error of 'pi' left over by the compensated sum, 0 for the other modes.
+    long long start;
+    long long end;
+    SeriesKernel kernel;
+    double scale;     // Multiplier for the sum of the batch, from the series.
+    SumMode sumMode;
+    WorkerSlot *slot; // Slot of the worker running the batch, for progress updates.
+    Precision precision;
+    long double sumLong; // Sum of the batch's terms (not times 4) for PREC_LONG_DOUBLE.
+    __float128 sumQuad;  // Sum of the batch's terms for PREC_QUAD.
+    FixedNum sumFixed;   // Sum of the batch's terms for PREC_FIXED.
+} Parameter;
+
+/* Double-ended queue of work for one worker of a work-stealing pool. The owner pushes and pops at the tail, so it keeps working
+   on the newest item, and the other workers steal from the head, which holds the oldest one (for the binary splitting, the
+   biggest subtree). Each deque has its own lock and cache line, so workers only ever wait on each other while stealing.
+*/
+typedef struct
+{
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    void **items;
+    int head;
+    int tail;
+    int capacity;
+} WorkDeque;
+
+void dequeInit(WorkDeque *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    q->capacity = 64;
+    q->items = (void **)malloc((size_t)q->capacity * sizeof(void *));
+    q->head = 0;
+    q->tail = 0;
+}
+
+void dequeFree(WorkDeque *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    free(q->items);
+}
+
+void dequePush(WorkDeque *q, void *item)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity)
+    {
+        // Move the items back to the front if thieves have emptied the head, otherwise grow.
+        if (q->head > 0)
+        {
+            memmove(q->items, q->items + q->head, (size_t)(q->tail - q->head) * sizeof(void *));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        else
+        {
+            q->capacity *= 2;
+            q->items = (void **)realloc(q->items, (size_t)q->capacity * sizeof(void *));
+        }
+    }
+    q->items[q->tail++] = item;
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Owner side, returns NULL if the deque is empty.
+void *dequePop(WorkDeque *q)
+{
+    void *item = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head)
+    {
+        item = q->items[--q->tail];
+    }
+    if (q->tail == q->head)
+    {
+        q->head = 0;
+        q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+// Thief side, returns NULL if the deque is empty.
+void *dequeSteal(WorkDeque *q)
+{
+    void *item = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head)
+    {
+        item = q->items[q->head++];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+/* The batches waiting to be processed. Every worker starts with an equal, contiguous share of the batches in its own deque and
+   works through it, and a worker whose deque runs dry steals the oldest batch from the deque of another worker. A slow or
+   interrupted core then only holds up the batch it is on, the rest of its share is taken over by the faster ones.
+   The target-precision mode instead claims batches in range order by atomically incrementing 'nextBatch': once a batch starts
+   past the point where the error bound meets 'tolerance', 'stopBatch' is lowered to it and nothing from there on is handed out,
+   which only works if every batch before it has been claimed.
+*/
+typedef struct
+{
+    Parameter *param;      // Array of every batch.
+    int batches;           // Number of batches in 'param'.
+    WorkDeque *deques;     // One deque of batches per worker, not used with a tolerance.
+    int workers;           // Number of deques.
+    atomic_int nextBatch;  // Index of the next batch that has not been claimed yet, with a tolerance.
+    double tolerance;      // Target error of Pi, 0 to always run every batch.
+    const Series *series;  // Series being summed, for its error bound.
+    atomic_int stopBatch;  // First batch that will not be handed out.
+    atomic_int finishedWorkers; // Number of pool threads that have run out of batches.
+} BatchQueue;
+
+/* Per-worker slot that the worker keeps writing to while it runs (progress counters). Each slot takes up a whole cache line of
+   its own, so updating it in the hot loop never touches a line another core is using. Only the owning worker writes to its slot,
+   other threads only read it through reduceProgress.
+*/
+struct WorkerSlot
+{
+    _Alignas(CACHE_LINE) atomic_llong termsDone; // Terms summed so far by this worker.
+    atomic_int batchesDone;                      // Batches finished by this worker.
+    atomic_int batchesStolen;                    // How many of those were taken from another worker's deque.
+    int worker;                                  // Index of the worker in the pool.
+    BatchQueue *queue;                           // Queue the worker takes batches from.
+};
+
+// Adds 'terms' to the progress of a slot. Only the owning worker calls this, so a plain load and store is enough.
+void addProgress(WorkerSlot *slot, long long terms)
+{
+    long long done = atomic_load_explicit(&slot->termsDone, memory_order_relaxed);
+    atomic_store_explicit(&slot->termsDone, done + terms, memory_order_relaxed);
+}
+
+// Reduction over the worker slots: the total number of terms summed so far by the whole pool.
+long long reduceProgress(WorkerSlot *slots, int count)
+{
+    long long total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        total += atomic_load_explicit(&slots[i].termsDone, memory_order_relaxed);
+    }
+    return total;
+}
+
+/* The scalar kernel avoids pow(-1, i) by working on pairs of terms. An even i is always positive and the odd i + 1 after it
+   is always negative, so with d = 2i + 1 the pair is 1/d - 1/(d + 2) = 2 / (d * (d + 2)), which only needs one divide.
+   If the range starts on an odd index that first (negative) term is added on its own, and an unpaired last term is added at the end.
+*/
+double leibnizScalar(long long start, long long end)
+{
+    double sum = 0;
+    long long i = start;
+
+    // Odd start: the first term is negative and has no partner.
+    if (i < end && (i & 1))
+    {
+        sum -= 1.0 / (2.0 * i + 1);
+        i++;
+    }
+    for (; i + 1 < end; i += 2)
+    {
+        double d = 2.0 * i + 1;
+        sum += 2.0 / (d * (d + 2));
+    }
+    // Even index left over at the end of the range.
+    if (i < end)
+    {
+        sum += 1.0 / (2.0 * i + 1);
+    }
+    return sum;
+}
+
+/* AVX2 version of the scalar kernel. Each lane holds the denominator d of one (even, odd) pair, so one pass of the loop
+   covers 4 pairs (8 terms). The denominators are stepped by 16 each pass instead of being rebuilt from i.
+*/
+__attribute__((target("avx2"))) double leibnizAVX2(long long start, long long end)
+{
+    double sum = 0;
+    long long i = start;
+
+    if (i < end && (i & 1))
+    {
+        sum += leibnizScalar(i, i + 1);
+        i++;
+    }
+
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d step = _mm256_set1_pd(16.0);
+    __m256d d = _mm256_set_pd(2.0 * i + 13, 2.0 * i + 9, 2.0 * i + 5, 2.0 * i + 1);
+    __m256d acc = _mm256_setzero_pd();
+    for (; end - i >= 8; i += 8)
+    {
+        acc = _mm256_add_pd(acc, _mm256_div_pd(two, _mm256_mul_pd(d, _mm256_add_pd(d, two))));
+        d = _mm256_add_pd(d, step);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    // Clear the upper halves of the registers before going back to non-AVX code, otherwise the SSE instructions in the
+    // scalar kernel pay a transition penalty on every batch.
+    _mm256_zeroupper();
+
+    // Whatever did not fill a full vector is finished by the scalar kernel.
+    return sum + leibnizScalar(i, end);
+}
+
+// AVX-512 version of the kernel above, 8 pairs (16 terms) per pass.
+__attribute__((target("avx512f"))) double leibnizAVX512(long long start, long long end)
+{
+    double sum = 0;
+    long long i = start;
+
+    if (i < end && (i & 1))
+    {
+        sum += leibnizScalar(i, i + 1);
+        i++;
+    }
+
+    const __m512d two = _mm512_set1_pd(2.0);
+    const __m512d step = _mm512_set1_pd(32.0);
+    __m512d d = _mm512_set_pd(2.0 * i + 29, 2.0 * i + 25, 2.0 * i + 21, 2.0 * i + 17,
+                              2.0 * i + 13, 2.0 * i + 9, 2.0 * i + 5, 2.0 * i + 1);
+    __m512d acc = _mm512_setzero_pd();
+    for (; end - i >= 16; i += 16)
+    {
+        acc = _mm512_add_pd(acc, _mm512_div_pd(two, _mm512_mul_pd(d, _mm512_add_pd(d, two))));
+        d = _mm512_add_pd(d, step);
+    }
+    sum += _mm512_reduce_add_pd(acc);
+    _mm256_zeroupper();
+
+    return sum + leibnizScalar(i, end);
+}
+
+/* Nilakantha series: Pi = 3 + 4 * sum of (-1)^k / ((2k + 2)(2k + 3)(2k + 4)). The signs alternate, so the kernel flips a
+   precomputed sign instead of calling pow, and the scale of 4 and the 3 are added by the series.
+*/
+double nilakanthaScalar(long long start, long long end)
+{
+    double sum = 0;
+    double sign = (start & 1) ? -1.0 : 1.0;
+    for (long long k = start; k < end; k++)
+    {
+        double a = 2.0 * k + 2;
+        sum += sign / (a * (a + 1) * (a + 2));
+        sign = -sign;
+    }
+    return sum;
+}
+
+/* AVX2 Nilakantha kernel, 8 terms per pass. As in leibnizAVX2 each lane adds a pair of terms at once: for an even k with
+   a = 2k + 2, 1/(a(a+1)(a+2)) - 1/((a+2)(a+3)(a+4)) = 6/(a(a+1)(a+3)(a+4)). Summing the signed terms lane by lane gave each
+   lane terms of one sign only, whose rounding errors all go the same way instead of cancelling, and that cost about 3 digits
+   compared to the scalar kernel. The pairs are all positive but shrink to far below the ulp of the lane's sum, so each lane
+   also keeps a compensation (Kahan) for the low bits every addition drops.
+*/
+__attribute__((target("avx2"))) double nilakanthaAVX2(long long start, long long end)
+{
+    double sum = 0;
+    long long k = start;
+
+    // The pairs have to start on an even k, where the term is positive.
+    if (k < end && (k & 1))
+    {
+        sum += nilakanthaScalar(k, k + 1);
+        k++;
+    }
+
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d three = _mm256_set1_pd(3.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d six = _mm256_set1_pd(6.0);
+    const __m256d step = _mm256_set1_pd(16.0);
+    __m256d a = _mm256_set_pd(2.0 * k + 14, 2.0 * k + 10, 2.0 * k + 6, 2.0 * k + 2);
+    __m256d acc = _mm256_setzero_pd();
+    __m256d compensation = _mm256_setzero_pd();
+    for (; end - k >= 8; k += 8)
+    {
+        __m256d denominator = _mm256_mul_pd(_mm256_mul_pd(a, _mm256_add_pd(a, one)),
+                                            _mm256_mul_pd(_mm256_add_pd(a, three), _mm256_add_pd(a, four)));
+        __m256d term = _mm256_sub_pd(_mm256_div_pd(six, denominator), compensation);
+        __m256d next = _mm256_add_pd(acc, term);
+        compensation = _mm256_sub_pd(_mm256_sub_pd(next, acc), term);
+        acc = next;
+        a = _mm256_add_pd(a, step);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_sub_pd(acc, compensation));
+    sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_zeroupper();
+
+    // Whatever did not fill a full vector is finished by the scalar kernel.
+    return sum + nilakanthaScalar(k, end);
+}
+
+// AVX-512 Nilakantha kernel, 16 terms (8 pairs) per pass with the same compensation.
+__attribute__((target("avx512f"))) double nilakanthaAVX512(long long start, long long end)
+{
+    double sum = 0;
+    long long k = start;
+
+    if (k < end && (k & 1))
+    {
+        sum += nilakanthaScalar(k, k + 1);
+        k++;
+    }
+
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d three = _mm512_set1_pd(3.0);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d six = _mm512_set1_pd(6.0);
+    const __m512d step = _mm512_set1_pd(32.0);
+    __m512d a = _mm512_set_pd(2.0 * k + 30, 2.0 * k + 26, 2.0 * k + 22, 2.0 * k + 18,
+                              2.0 * k + 14, 2.0 * k + 10, 2.0 * k + 6, 2.0 * k + 2);
+    __m512d acc = _mm512_setzero_pd();
+    __m512d compensation = _mm512_setzero_pd();
+    for (; end - k >= 16; k += 16)
+    {
+        __m512d denominator = _mm512_mul_pd(_mm512_mul_pd(a, _mm512_add_pd(a, one)),
+                                            _mm512_mul_pd(_mm512_add_pd(a, three), _mm512_add_pd(a, four)));
+        __m512d term = _mm512_sub_pd(_mm512_div_pd(six, denominator), compensation);
+        __m512d next = _mm512_add_pd(acc, term);
+        compensation = _mm512_sub_pd(_mm512_sub_pd(next, acc), term);
+        acc = next;
+        a = _mm512_add_pd(a, step);
+    }
+    sum += _mm512_reduce_add_pd(_mm512_sub_pd(acc, compensation));
+    _mm256_zeroupper();
+
+    return sum + nilakanthaScalar(k, end);
+}
+
+// Past this many terms both powers in Machin's formula are below the smallest double, so the terms are exactly 0.
+#define MACHIN_TERMS 232
+
+/* Machin's formula: Pi = 16 arctan(1/5) - 4 arctan(1/239), with both arctans summed as their Taylor series, so term k is
+   (-1)^k (16 / 5^(2k+1) - 4 / 239^(2k+1)) / (2k + 1). The powers are started once with pow and then divided down each term.
+*/
+double machinScalar(long long start, long long end)
+{
+    if (end > MACHIN_TERMS)
+    {
+        end = MACHIN_TERMS;
+    }
+    double sum = 0;
+    double x = pow(25.0, -(double)start) / 5;
+    double y = pow(57121.0, -(double)start) / 239;
+    double sign = (start & 1) ? -1.0 : 1.0;
+    for (long long k = start; k < end; k++)
+    {
+        sum += sign * (16 * x - 4 * y) / (2.0 * k + 1);
+        x /= 25;
+        y /= 57121;
+        sign = -sign;
+    }
+    return sum;
+}
+
+// AVX2 Machin kernel, lane j holds term k + j and the powers of every lane are divided by 25^4 and 239^8 each pass.
+__attribute__((target("avx2"))) double machinAVX2(long long start, long long end)
+{
+    if (end > MACHIN_TERMS)
+    {
+        end = MACHIN_TERMS;
+    }
+    long long k = start;
+    if (end - k < 4)
+    {
+        return machinScalar(k, end);
+    }
+    double s = (start & 1) ? -1.0 : 1.0;
+    double x = pow(25.0, -(double)k) / 5;
+    double y = pow(57121.0, -(double)k) / 239;
+    const __m256d sign = _mm256_set_pd(-s, s, -s, s);
+    const __m256d sixteen = _mm256_set1_pd(16.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d xStep = _mm256_set1_pd(390625.0);    // 25^4
+    const __m256d yStep = _mm256_set1_pd(3262808641.0); // 57121^2, applied twice
+    const __m256d dStep = _mm256_set1_pd(8.0);
+    __m256d xs = _mm256_set_pd(x / 15625, x / 625, x / 25, x);
+    __m256d ys = _mm256_set_pd(y / 57121 / 57121 / 57121, y / 57121 / 57121, y / 57121, y);
+    __m256d d = _mm256_set_pd(2.0 * k + 7, 2.0 * k + 5, 2.0 * k + 3, 2.0 * k + 1);
+    __m256d acc = _mm256_setzero_pd();
+    for (; end - k >= 4; k += 4)
+    {
+        __m256d numerator = _mm256_sub_pd(_mm256_mul_pd(sixteen, xs), _mm256_mul_pd(four, ys));
+        acc = _mm256_add_pd(acc, _mm256_div_pd(_mm256_mul_pd(sign, numerator), d));
+        xs = _mm256_div_pd(xs, xStep);
+        ys = _mm256_div_pd(_mm256_div_pd(ys, yStep), yStep);
+        d = _mm256_add_pd(d, dStep);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    _mm256_zeroupper();
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + machinScalar(k, end);
+}
+
+// AVX-512 Machin kernel, 8 terms per pass.
+__attribute__((target("avx512f"))) double machinAVX512(long long start, long long end)
+{
+    if (end > MACHIN_TERMS)
+    {
+        end = MACHIN_TERMS;
+    }
+    long long k = start;
+    if (end - k < 8)
+    {
+        return machinScalar(k, end);
+    }
+    double s = (start & 1) ? -1.0 : 1.0;
+    double x[8];
+    double y[8];
+    x[0] = pow(25.0, -(double)k) / 5;
+    y[0] = pow(57121.0, -(double)k) / 239;
+    for (int j = 1; j < 8; j++)
+    {
+        x[j] = x[j - 1] / 25;
+        y[j] = y[j - 1] / 57121;
+    }
+    const __m512d sign = _mm512_set_pd(-s, s, -s, s, -s, s, -s, s);
+    const __m512d sixteen = _mm512_set1_pd(16.0);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d xStep = _mm512_set1_pd(152587890625.0); // 25^8
+    const __m512d yStep = _mm512_set1_pd(3262808641.0);   // 57121^2, applied four times
+    const __m512d dStep = _mm512_set1_pd(16.0);
+    __m512d xs = _mm512_loadu_pd(x);
+    __m512d ys = _mm512_loadu_pd(y);
+    __m512d d = _mm512_set_pd(2.0 * k + 15, 2.0 * k + 13, 2.0 * k + 11, 2.0 * k + 9,
+                              2.0 * k + 7, 2.0 * k + 5, 2.0 * k + 3, 2.0 * k + 1);
+    __m512d acc = _mm512_setzero_pd();
+    for (; end - k >= 8; k += 8)
+    {
+        __m512d numerator = _mm512_sub_pd(_mm512_mul_pd(sixteen, xs), _mm512_mul_pd(four, ys));
+        acc = _mm512_add_pd(acc, _mm512_div_pd(_mm512_mul_pd(sign, numerator), d));
+        xs = _mm512_div_pd(xs, xStep);
+        ys = _mm512_div_pd(_mm512_div_pd(_mm512_div_pd(_mm512_div_pd(ys, yStep), yStep), yStep), yStep);
+        d = _mm512_add_pd(d, dStep);
+    }
+
+    double sum = _mm512_reduce_add_pd(acc);
+    _mm256_zeroupper();
+    return sum + machinScalar(k, end);
+}
+
+// Past this many terms the Chudnovsky terms are below the smallest double.
+#define CHUDNOVSKY_TERMS 22
+
+/* Ratio between Chudnovsky term k and term k - 1 without the linear factor:
+   -(6k)! (3k - 3)! ((k - 1)!)^3 / ((6k - 6)! (3k)! (k!)^3 640320^3) = -24 (6k - 5)(2k - 1)(6k - 1) / (k^3 640320^3).
+*/
+double chudnovskyRatio(long long k)
+{
+    double kk = (double)k;
+    return -24.0 * (6 * kk - 5) * (2 * kk - 1) * (6 * kk - 1) / (kk * kk * kk * 262537412640768000.0);
+}
+
+/* Binary splitting of the Chudnovsky series over [a, b). Returns U, the sum over k of (13591409 + 545140134 k) r(a) r(a + 1) ... r(k),
+   and stores R = r(a) ... r(b - 1) in *ratio (with r(0) = 1). Joining [a, m) and [m, b) is R = R1 R2 and U = U1 + R1 U2, the same
+   step as the integer P, Q, T form but divided through by Q so that it fits in a double.
+*/
+double chudnovskySplit(long long a, long long b, double *ratio)
+{
+    if (b - a == 1)
+    {
+        double r = (a == 0) ? 1.0 : chudnovskyRatio(a);
+        *ratio = r;
+        return r * (13591409.0 + 545140134.0 * a);
+    }
+    long long m = (a + b) / 2;
+    double leftRatio;
+    double rightRatio;
+    double left = chudnovskySplit(a, m, &leftRatio);
+    double right = chudnovskySplit(m, b, &rightRatio);
+    *ratio = leftRatio * rightRatio;
+    return left + leftRatio * right;
+}
+
+/* Chudnovsky kernel: Pi = 426880 sqrt(10005) / sum, where every term adds about 14 digits. A batch that does not start at 0
+   needs the product of the ratios before it, which is cheap because only CHUDNOVSKY_TERMS terms are ever non-zero.
+   There is no SIMD version: in double precision the whole series is two or three terms.
+*/
+double chudnovskyScalar(long long start, long long end)
+{
+    if (end > CHUDNOVSKY_TERMS)
+    {
+        end = CHUDNOVSKY_TERMS;
+    }
+    if (start >= end)
+    {
+        return 0;
+    }
+    double before = 1;
+    for (long long k = 1; k < start; k++)
+    {
+        before *= chudnovskyRatio(k);
+    }
+    double ratio;
+    return before * chudnovskySplit(start, end, &ratio);
+}
+
+double finishSum(double total)
+{
+    return total;
+}
+
+double finishNilakantha(double total)
+{
+    return 3 + total;
+}
+
+double finishChudnovsky(double total)
+{
+    return 426880 * sqrt(10005.0) / total;
+}
+
+// Error bounds after n terms. The first three series alternate with shrinking terms, so the next term is a bound.
+double leibnizBound(long long n)
+{
+    return 4.0 / (2.0 * n + 1);
+}
+
+double nilakanthaBound(long long n)
+{
+    double a = 2.0 * n + 2;
+    return 4.0 / (a * (a + 1) * (a + 2));
+}
+
+double machinBound(long long n)
+{
+    return (16 * pow(5.0, -(2.0 * n + 1)) + 4 * pow(239.0, -(2.0 * n + 1))) / (2.0 * n + 1);
+}
+
+// Each Chudnovsky term is about 151931373056000 (= 640320^3 / 1728) times smaller than the one before.
+double chudnovskyBound(long long n)
+{
+    return 4 * pow(151931373056000.0, -(double)n);
+}
+
+// Every series that can be picked with --series, the first one is the default.
+const Series seriesList[] = {
+    {"leibniz", leibnizScalar, leibnizAVX2, leibnizAVX512, 4.0, finishSum, leibnizBound},
+    {"nilakantha", nilakanthaScalar, nilakanthaAVX2, nilakanthaAVX512, 4.0, finishNilakantha, nilakanthaBound},
+    {"machin", machinScalar, machinAVX2, machinAVX512, 1.0, finishSum, machinBound},
+    {"chudnovsky", chudnovskyScalar, NULL, NULL, 1.0, finishChudnovsky, chudnovskyBound},
+};
+#define SERIES_COUNT (int)(sizeof(seriesList) / sizeof(seriesList[0]))
+
+/* Returns the kernel of 'series' matching the --kernel option. "simd" uses the widest instruction set the CPU reports at runtime,
+   so the same binary still runs on machines without AVX. The name of the kernel picked is stored in 'label'.
+   Returns NULL if the option is not recognised.
+*/
+SeriesKernel selectKernel(const Series *series, const char *name, const char **label)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        *label = "scalar";
+        return series->scalar;
+    }
+    if (strcmp(name, "simd") == 0)
+    {
+        __builtin_cpu_init();
+        if (series->avx512 != NULL && __builtin_cpu_supports("avx512f"))
+        {
+            *label = "avx512";
+            return series->avx512;
+        }
+        if (series->avx2 != NULL && __builtin_cpu_supports("avx2"))
+        {
+            *label = "avx2";
+            return series->avx2;
+        }
+        *label = (series->avx2 == NULL) ? "scalar (no simd kernel for this series)" : "scalar (no avx2 on this cpu)";
+        return series->scalar;
+    }
+    return NULL;
+}
+
+// Creates a fixed-point number of 'count' limbs set to 0.
+FixedNum fixedCreate(int count)
+{
+    FixedNum x;
+    x.limb = (uint32_t *)calloc(count, sizeof(uint32_t));
+    x.count = count;
+    return x;
+}
+
+void fixedFree(FixedNum *x)
+{
+    free(x->limb);
+    x->limb = NULL;
+    x->count = 0;
+}
+
+// dst += src, both must have the same number of limbs. Works from the least significant limb up, carrying into the next one.
+void fixedAdd(FixedNum *dst, const FixedNum *src)
+{
+    uint64_t carry = 0;
+    for (int k = dst->count - 1; k >= 0; k--)
+    {
+        uint64_t total = (uint64_t)dst->limb[k] + src->limb[k] + carry;
+        dst->limb[k] = (uint32_t)total;
+        carry = total >> 32;
+    }
+}
+
+// dst -= src, both must have the same number of limbs.
+void fixedSub(FixedNum *dst, const FixedNum *src)
+{
+    uint64_t borrow = 0;
+    for (int k = dst->count - 1; k >= 0; k--)
+    {
+        uint64_t total = (uint64_t)dst->limb[k] - src->limb[k] - borrow;
+        dst->limb[k] = (uint32_t)total;
+        borrow = (total >> 32) & 1;
+    }
+}
+
+// x *= m for a non-negative x.
+void fixedMulSmall(FixedNum *x, uint32_t m)
+{
+    uint64_t carry = 0;
+    for (int k = x->count - 1; k >= 0; k--)
+    {
+        uint64_t total = (uint64_t)x->limb[k] * m + carry;
+        x->limb[k] = (uint32_t)total;
+        carry = total >> 32;
+    }
+}
+
+/* x /= d for a non-negative x, by long division from the most significant limb down (the last bits are truncated).
+   Divisors that fit in 32 bits only need 64-bit arithmetic, bigger ones (2i + 1 past 2^32) fall back to 128-bit.
+*/
+void fixedDivSmall(FixedNum *x, uint64_t d)
+{
+    if (d <= 0xFFFFFFFFu)
+    {
+        uint64_t rem = 0;
+        for (int k = 0; k < x->count; k++)
+        {
+            uint64_t current = (rem << 32) | x->limb[k];
+            x->limb[k] = (uint32_t)(current / d);
+            rem = current % d;
+        }
+    }
+    else
+    {
+        unsigned __int128 rem = 0;
+        for (int k = 0; k < x->count; k++)
+        {
+            unsigned __int128 current = (rem << 32) | x->limb[k];
+            x->limb[k] = (uint32_t)(current / d);
+            rem = current % d;
+        }
+    }
+}
+
+int fixedIsZero(const FixedNum *x)
+{
+    for (int k = 0; k < x->count; k++)
+    {
+        if (x->limb[k] != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Writes the integer part and 'digits' decimals of a non-negative x into 'out' (the decimals are truncated, not rounded).
+   The fraction is multiplied by 10^9 at a time and whatever overflows into the integer limb is the next 9 digits.
+*/
+void fixedToDecimal(const FixedNum *x, char *out, int digits)
+{
+    FixedNum frac = fixedCreate(x->count);
+    memcpy(frac.limb, x->limb, x->count * sizeof(uint32_t));
+    out += sprintf(out, "%u.", frac.limb[0]);
+    for (int written = 0; written < digits; written += 9)
+    {
+        frac.limb[0] = 0;
+        fixedMulSmall(&frac, 1000000000u);
+        char chunk[16];
+        sprintf(chunk, "%09u", frac.limb[0]);
+        int take = (digits - written < 9) ? digits - written : 9;
+        memcpy(out, chunk, take);
+        out += take;
+    }
+    *out = '\0';
+    fixedFree(&frac);
+}
+
+/* Extended precision versions of the scalar kernel. They use the same pairing of an even and an odd term, but the running sum
+   is kept in the wider type. These do not vectorise, which is the price of the extra digits.
+*/
+long double leibnizLongDouble(long long start, long long end)
+{
+    long double sum = 0;
+    long long i = start;
+    if (i < end && (i & 1))
+    {
+        sum -= 1.0L / (2.0L * i + 1);
+        i++;
+    }
+    for (; i + 1 < end; i += 2)
+    {
+        long double d = 2.0L * i + 1;
+        sum += 2.0L / (d * (d + 2));
+    }
+    if (i < end)
+    {
+        sum += 1.0L / (2.0L * i + 1);
+    }
+    return sum;
+}
+
+__float128 leibnizQuad(long long start, long long end)
+{
+    __float128 sum = 0;
+    long long i = start;
+    if (i < end && (i & 1))
+    {
+        sum -= 1 / ((__float128)2 * i + 1);
+        i++;
+    }
+    for (; i + 1 < end; i += 2)
+    {
+        __float128 d = (__float128)2 * i + 1;
+        sum += 2 / (d * (d + 2));
+    }
+    if (i < end)
+    {
+        sum += 1 / ((__float128)2 * i + 1);
+    }
+    return sum;
+}
+
+/* Fixed-point kernel: each term 1 / (2i + 1) is worked out by long division into 'scratch' and then added to or taken away from 'sum'.
+   Every term costs a few passes over all the limbs, so the time per term grows with the number of digits.
+*/
+void leibnizFixed(FixedNum *sum, FixedNum *scratch, long long start, long long end)
+{
+    for (long long i = start; i < end; i++)
+    {
+        memset(scratch->limb, 0, scratch->count * sizeof(uint32_t));
+        scratch->limb[0] = 1;
+        fixedDivSmall(scratch, 2 * (uint64_t)i + 1);
+        if (i & 1)
+        {
+            fixedSub(sum, scratch);
+        }
+        else
+        {
+            fixedAdd(sum, scratch);
+        }
+    }
+}
+
+/* Adds x to the running sum *s and keeps the rounding error of that addition in *c. This is Neumaier's version of Kahan
+   summation, which also copes with x being bigger than the running sum. The corrected total is *s + *c.
+*/
+void neumaierAdd(double *s, double *c, double x)
+{
+    double t = *s + x;
+    if (fabs(*s) >= fabs(x))
+    {
+        *c += (*s - t) + x;
+    }
+    else
+    {
+        *c += (x - t) + *s;
+    }
+    *s = t;
+}
+
+/* Pairwise sum of a range. Ranges bigger than SUM_BLOCK are split in half and the two halves are added, so each term only
+   goes through about log2(n) additions. The split is rounded down to an even term index (not an even offset from 'start'),
+   so only the first block of an odd range starts with an odd term and every other block starts on a whole pair.
+*/
+double pairwiseRange(SeriesKernel kernel, WorkerSlot *slot, long long start, long long end)
+{
+    if (end - start <= SUM_BLOCK)
+    {
+        double sum = kernel(start, end);
+        addProgress(slot, end - start);
+        return sum;
+    }
+    long long mid = (start + (end - start) / 2) & ~1LL;
+    return pairwiseRange(kernel, slot, start, mid) + pairwiseRange(kernel, slot, mid, end);
+}
+
+/* The leibnizFormula function calculates the sum of the Leibniz formula for every i within a specified range.
+   It then stores the result in the pi member of a parameter struct.
+   With the compensated sum the kernel is run on blocks of SUM_BLOCK terms and the block sums are added with neumaierAdd,
+   which keeps the kernels vectorised while the long running sum across blocks does not lose the small terms.
+   Progress is written to the worker's slot after every block, the plain sum is also cut into blocks of PROGRESS_BLOCK terms for this.
+   For testing purposes I added printf for the batch number and the start and end points to gain better understanding of each process for each batch.
+*/
+
+void *leibnizFormula(void *p)
+{
+    Parameter *param = (Parameter *)p;
+
+    // The extended precision types have their own kernels and always keep the whole sum in the wider type.
+    if (param->precision != PREC_DOUBLE)
+    {
+        long long block = (param->precision == PREC_FIXED) ? SUM_BLOCK : PROGRESS_BLOCK;
+        FixedNum scratch = {NULL, 0};
+        if (param->precision == PREC_FIXED)
+        {
+            scratch = fixedCreate(param->sumFixed.count);
+        }
+        for (long long i = param->start; i < param->end; i += block)
+        {
+            long long blockEnd = (param->end - i > block) ? i + block : param->end;
+            if (param->precision == PREC_LONG_DOUBLE)
+            {
+                param->sumLong += leibnizLongDouble(i, blockEnd);
+            }
+            else if (param->precision == PREC_QUAD)
+            {
+                param->sumQuad += leibnizQuad(i, blockEnd);
+            }
+            else
+            {
+                leibnizFixed(&param->sumFixed, &scratch, i, blockEnd);
+            }
+            addProgress(param->slot, blockEnd - i);
+        }
+        fixedFree(&scratch);
+        return NULL;
+    }
+
+    /* Applying Leibniz Formula */
+    // printf("Batch number: %d\n", param->batch);
+    // printf("Start:%lld\tEnd:%lld\n", param->start, param->end);
+    double sum = 0;
+    double compensation = 0;
+    if (param->sumMode == SUM_NEUMAIER)
+    {
+        for (long long i = param->start; i < param->end; i += SUM_BLOCK)
+        {
+            long long blockEnd = (param->end - i > SUM_BLOCK) ? i + SUM_BLOCK : param->end;
+            neumaierAdd(&sum, &compensation, param->kernel(i, blockEnd));
+            addProgress(param->slot, blockEnd - i);
+        }
+    }
+    else if (param->sumMode == SUM_PAIRWISE)
+    {
+        sum = pairwiseRange(param->kernel, param->slot, param->start, param->end);
+    }
+    else
+    {
+        for (long long i = param->start; i < param->end; i += PROGRESS_BLOCK)
+        {
+            long long blockEnd = (param->end - i > PROGRESS_BLOCK) ? i + PROGRESS_BLOCK : param->end;
+            sum += param->kernel(i, blockEnd);
+            addProgress(param->slot, blockEnd - i);
+        }
+    }
+    // The scale of every series is a power of 2, so multiplying is exact and the compensation scales with the sum.
+    param->pi = param->scale * sum;
+    param->piError = param->scale * compensation;
+    return NULL;
+}
+
+// Runs one batch on the worker of 'slot' and counts it in the slot.
+void runBatch(WorkerSlot *slot, Parameter *param)
+{
+    param->slot = slot;
+    if (param->precision == PREC_FIXED)
+    {
+        param->sumFixed = fixedCreate(param->sumFixed.count);
+    }
+    leibnizFormula(param);
+    atomic_store_explicit(&slot->batchesDone, atomic_load_explicit(&slot->batchesDone, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/* Each thread of the pool keeps taking batches and running leibnizFormula on them until there are none left, so the number
+   of threads stays fixed no matter how many batches the user asks for. 's' is the worker's own slot.
+*/
+void *poolWorker(void *s)
+{
+    WorkerSlot *slot = (WorkerSlot *)s;
+    BatchQueue *queue = slot->queue;
+
+    if (queue->tolerance > 0)
+    {
+        for (;;)
+        {
+            int i = atomic_fetch_add_explicit(&queue->nextBatch, 1, memory_order_relaxed);
+            if (i >= atomic_load_explicit(&queue->stopBatch, memory_order_relaxed))
+            {
+                break;
+            }
+            // For an alternating series with shrinking terms, the error after the first n terms is below the size of term n,
+            // for Leibniz |Pi - 4 S(n)| < 4 / (2n + 1). Every batch before this one has already been claimed, so if they are enough
+            // this batch is not needed and neither is anything after it.
+            if (i > 0 && queue->series->errorBound(queue->param[i].start) < queue->tolerance)
+            {
+                int stop = atomic_load_explicit(&queue->stopBatch, memory_order_relaxed);
+                while (i < stop && !atomic_compare_exchange_weak(&queue->stopBatch, &stop, i))
+                {
+                }
+                break;
+            }
+            runBatch(slot, &queue->param[i]);
+        }
+    }
+    else
+    {
+        // Nothing is added to the deques once the pool is running, so when every deque is empty the work is done.
+        for (;;)
+        {
+            Parameter *param = (Parameter *)dequePop(&queue->deques[slot->worker]);
+            for (int i = 1; param == NULL && i < queue->workers; i++)
+            {
+                param = (Parameter *)dequeSteal(&queue->deques[(slot->worker + i) % queue->workers]);
+                if (param != NULL)
+                {
+                    atomic_store_explicit(&slot->batchesStolen, atomic_load_explicit(&slot->batchesStolen, memory_order_relaxed) + 1,
+                                          memory_order_relaxed);
+                }
+            }
+            if (param == NULL)
+            {
+                break;
+            }
+            runBatch(slot, param);
+        }
+    }
+    atomic_fetch_add(&queue->finishedWorkers, 1);
+    return NULL;
+}
+
+/* Adds up the results of 'count' batches with the chosen summation mode. The compensated mode carries each batch's own
+   compensation along, and the pairwise mode adds the two halves of the batch array recursively.
+*/
+double reduceBatches(const Parameter *param, int count, SumMode mode)
+{
+    double sum = 0;
+    double compensation = 0;
+    if (mode == SUM_PAIRWISE)
+    {
+        if (count == 1)
+        {
+            return param[0].pi + param[0].piError;
+        }
+        return reduceBatches(param, count / 2, mode) + reduceBatches(param + count / 2, count - count / 2, mode);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (mode == SUM_NEUMAIER)
+        {
+            neumaierAdd(&sum, &compensation, param[i].pi);
+            compensation += param[i].piError;
+        }
+        else
+        {
+            sum += param[i].pi;
+        }
+    }
+    return sum + compensation;
+}
+
+// Adds the extended precision sum of batch 'src' into batch 'dst'.
+void addWide(Parameter *dst, const Parameter *src)
+{
+    if (dst->precision == PREC_LONG_DOUBLE)
+    {
+        dst->sumLong += src->sumLong;
+    }
+    else if (dst->precision == PREC_QUAD)
+    {
+        dst->sumQuad += src->sumQuad;
+    }
+    else if (dst->precision == PREC_FIXED)
+    {
+        fixedAdd(&dst->sumFixed, &src->sumFixed);
+    }
+}
+
+// One round of the tree reduction, shared out between the threads. Each thread adds every 'step'-th pair starting at 'first'.
+typedef struct
+{
+    Parameter *param; // Batches being reduced.
+    int count;        // Number of batches.
+    int stride;       // Distance between the two batches of a pair in this round.
+    int first;        // First pair handled by this thread.
+    int step;         // Number of threads sharing the round.
+} ReduceRound;
+
+void *reduceRoundWorker(void *r)
+{
+    ReduceRound *round = (ReduceRound *)r;
+    for (int pair = round->first;; pair += round->step)
+    {
+        int i = pair * 2 * round->stride;
+        if (i + round->stride >= round->count)
+        {
+            break;
+        }
+        addWide(&round->param[i], &round->param[i + round->stride]);
+    }
+    return NULL;
+}
+
+/* Parallel tree reduction of the extended precision batch sums, the total ends up in param[0]. In every round batch i takes in
+   batch i + stride and the stride doubles, so there are log2(count) rounds and the pairs within a round are split between
+   'numThreads' threads. Big fixed-point numbers are slow to add, so this keeps the reduction from becoming the bottleneck.
+*/
+void reduceWide(Parameter *param, int count, int numThreads)
+{
+    pthread_t *threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+    ReduceRound *rounds = (ReduceRound *)calloc(numThreads, sizeof(ReduceRound));
+    for (int stride = 1; stride < count; stride *= 2)
+    {
+        int pairs = (count - stride + 2 * stride - 1) / (2 * stride);
+        int used = (pairs < numThreads) ? pairs : numThreads;
+        for (int t = 0; t < used; t++)
+        {
+            rounds[t].param = param;
+            rounds[t].count = count;
+            rounds[t].stride = stride;
+            rounds[t].first = t;
+            rounds[t].step = used;
+        }
+        // A single pair is not worth a thread.
+        if (used == 1)
+        {
+            reduceRoundWorker(&rounds[0]);
+            continue;
+        }
+        for (int t = 0; t < used; t++)
+        {
+            pthread_create(threads + t, NULL, reduceRoundWorker, (void *)&rounds[t]);
+        }
+        for (int t = 0; t < used; t++)
+        {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    free(rounds);
+    free(threads);
+}
+
+/* Extended precision versions of eulerTail, they return the tail of the series (not times 4) with the sign of term n. */
+long double eulerTailLong(long long n)
+{
+    long double c = 2.0L * n + 1;
+    long double term = 1 / (2 * c);
+    long double tail = 0;
+    for (int m = 0; m < 400 && term > 1e-21L * tail; m++)
+    {
+        tail += term;
+        term *= (m + 1) / (c + 2.0L * (m + 1));
+    }
+    return (n & 1) ? -tail : tail;
+}
+
+__float128 eulerTailQuad(long long n)
+{
+    __float128 c = (__float128)2 * n + 1;
+    __float128 term = 1 / (2 * c);
+    __float128 tail = 0;
+    for (int m = 0; m < 400 && term > tail / 1e36; m++)
+    {
+        tail += term;
+        term *= (m + 1) / (c + (__float128)2 * (m + 1));
+    }
+    return (n & 1) ? -tail : tail;
+}
+
+// Fixed-point version, adds the tail (with its sign) into 'sum'. The terms shrink by at least half each time, so it stops once one is 0.
+void eulerTailFixed(FixedNum *sum, long long n)
+{
+    uint64_t c = 2 * (uint64_t)n + 1;
+    FixedNum term = fixedCreate(sum->count);
+    FixedNum tail = fixedCreate(sum->count);
+    term.limb[0] = 1;
+    fixedDivSmall(&term, 2 * c);
+    for (uint32_t m = 0; !fixedIsZero(&term); m++)
+    {
+        fixedAdd(&tail, &term);
+        fixedMulSmall(&term, m + 1);
+        fixedDivSmall(&term, c + 2 * (uint64_t)(m + 1));
+    }
+    if (n & 1)
+    {
+        fixedSub(sum, &tail);
+    }
+    else
+    {
+        fixedAdd(sum, &tail);
+    }
+    fixedFree(&term);
+    fixedFree(&tail);
+}
+
+// Writes 'digits' decimals of a positive __float128 into 'out' (truncated), without needing libquadmath.
+void quadToDecimal(__float128 x, char *out, int digits)
+{
+    int whole = (int)x;
+    __float128 frac = x - whole;
+    out += sprintf(out, "%d.", whole);
+    for (int i = 0; i < digits; i++)
+    {
+        frac *= 10;
+        int digit = (int)frac;
+        frac -= digit;
+        *out++ = (char)('0' + digit);
+    }
+    *out = '\0';
+}
+
+/* Socket (physical package) of a CPU as reported by sysfs, 0 if it can not be read.
+*/
+int cpuSocket(int cpu)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *file = fopen(path, "r");
+    int socket = 0;
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &socket) != 1)
+        {
+            socket = 0;
+        }
+        fclose(file);
+    }
+    return socket;
+}
+
+/* Works out which CPU each worker gets pinned to for --affinity, worker i runs on cpus[i % count].
+   "compact" fills every CPU of one socket before moving on to the next, so the workers share caches.
+   "scatter" deals the workers out over the sockets in turn, so every socket's memory bandwidth gets used.
+   A list such as "0,2,8-11" is used as it is. Returns the number of CPUs, or -1 if 'mode' is not valid or names a CPU this
+   process may not run on.
+*/
+int affinityPlan(const char *mode, int *cpus, int max)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return -1;
+    }
+    int count = 0;
+
+    if (strcmp(mode, "compact") == 0 || strcmp(mode, "scatter") == 0)
+    {
+        int socket[CPU_SETSIZE];
+        int rank[CPU_SETSIZE];
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus[count] = cpu;
+                socket[count] = cpuSocket(cpu);
+                // How many CPUs of the same socket come before this one.
+                rank[count] = 0;
+                for (int j = 0; j < count; j++)
+                {
+                    rank[count] += socket[j] == socket[count];
+                }
+                count++;
+            }
+        }
+        // Insertion sort, by socket for compact and by (rank, socket) for scatter. Ties keep the CPU number order.
+        int scatter = strcmp(mode, "scatter") == 0;
+        for (int i = 1; i < count; i++)
+        {
+            int cpu = cpus[i];
+            int s = socket[i];
+            int r = rank[i];
+            int j = i - 1;
+            while (j >= 0 && (scatter ? (rank[j] > r || (rank[j] == r && socket[j] > s)) : socket[j] > s))
+            {
+                cpus[j + 1] = cpus[j];
+                socket[j + 1] = socket[j];
+                rank[j + 1] = rank[j];
+                j--;
+            }
+            cpus[j + 1] = cpu;
+            socket[j + 1] = s;
+            rank[j + 1] = r;
+        }
+        return count;
+    }
+
+    const char *text = mode;
+    while (*text != '\0')
+    {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+        if (end == text || first < 0)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || last < first)
+            {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == max || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+            {
+                return -1;
+            }
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end != '\0')
+        {
+            return -1;
+        }
+        text = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+/* Initialises 'attr' for the thread of 'worker' so that it starts on its CPU. Without a plan (count 0) the attributes are the
+   defaults and the scheduler places the thread.
+*/
+void affinityAttr(pthread_attr_t *attr, const int *cpus, int count, int worker)
+{
+    pthread_attr_init(attr);
+    if (count > 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[worker % count], &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+}
+
+// Everything needed for one calculation of Pi, filled in from the command line.
+typedef struct
+{
+    long long iterations; // Number of terms of the series.
+    int batches;          // Number of batches the terms are split into.
+    int threads;          // Number of threads in the pool.
+    const Series *series; // Series used to work out Pi.
+    SeriesKernel kernel;  // Kernel of that series used to sum each batch.
+    SumMode sumMode;      // How terms and batches are added together.
+    AccelMode accel;      // Acceleration applied to the partial sums.
+    double tolerance;     // Stop once the error bound is below this, 0 to use every iteration.
+    int progress;         // Print the progress while the pool is running.
+    Precision precision;  // Number type used for the sums.
+    int fixedDigits;      // Decimal digits the FixedNum type is sized for.
+    const int *cpus;      // CPU of each pool thread from --affinity, NULL to leave it to the scheduler.
+    int cpuCount;         // Number of entries in 'cpus'.
+} RunSettings;
+
+// Result of computePi. Besides 'pi' as a double, only the field for the chosen precision is filled in.
+typedef struct
+{
+    double pi;
+    long double piLong;
+    __float128 piQuad;
+    FixedNum piFixed; // Owned by the result, freed with fixedFree.
+    long long termsUsed;
+    int workers;       // Number of pool threads.
+    int *workerChunks; // Batches run by each pool thread, owned by the result.
+    int *workerSteals; // How many of those each thread stole, owned by the result.
+} PiResult;
+
+// Term i of the series, (-1)^i / (2i + 1).
+double leibnizTerm(long long i)
+{
+    return ((i & 1) ? -1.0 : 1.0) / (2.0 * i + 1);
+}
+
+/* Euler-van Wijngaarden transform: the partial sum of the first n terms is kept and the rest of the series is summed with
+   the Euler transform. For terms 1/(c + 2j) with c = 2n + 1 the m-th forward difference has a closed form, which turns the
+   transformed tail into the sum over m of m! / (2 c (c + 2) ... (c + 2m)). Every term is at most half of the one before,
+   so this stops after a few dozen terms even when n is 0. Returns 4 * the tail, with the sign of term n.
+*/
+double eulerTail(long long n)
+{
+    double c = 2.0 * n + 1;
+    double term = 1.0 / (2 * c);
+    double tail = 0;
+    for (int m = 0; m < 200 && term > 1e-18 * tail; m++)
+    {
+        tail += term;
+        term *= (m + 1) / (c + 2.0 * (m + 1));
+    }
+    return (n & 1) ? -4 * tail : 4 * tail;
+}
+
+/* Iterated Aitken delta-squared on the partial sums 4 S(n - 2 * AITKEN_LEVELS), ..., 4 S(n). The earlier partial sums are the
+   total with its last few terms taken off again, so they cost nothing extra. Each pass replaces three neighbouring
+   partial sums s0, s1, s2 with s2 - (s2 - s1)^2 / (s2 - 2 s1 + s0).
+*/
+double aitkenExtrapolate(double total, long long n)
+{
+    double s[2 * AITKEN_LEVELS + 1];
+    int count = 2 * AITKEN_LEVELS + 1;
+    if (n < count)
+    {
+        count = (int)n;
+    }
+    if (count < 3)
+    {
+        return total;
+    }
+
+    s[count - 1] = total;
+    for (int k = count - 1; k > 0; k--)
+    {
+        s[k - 1] = s[k] - 4 * leibnizTerm(n - (count - k));
+    }
+    for (; count >= 3; count -= 2)
+    {
+        for (int i = 0; i + 2 < count; i++)
+        {
+            double d = s[i + 2] - 2 * s[i + 1] + s[i];
+            double step = s[i + 2] - s[i + 1];
+            s[i] = (d == 0) ? s[i + 2] : s[i + 2] - step * step / d;
+        }
+    }
+    return s[0];
+}
+
+/* Richardson extrapolation on partial sums taken at the batch boundaries closest to N, N/2, N/4, ... For a fixed parity of n the
+   error of 4 S(n) is a smooth series in 1/n, so the partial sums are fitted with a polynomial in x = 1/n and evaluated at x = 0
+   (Neville's scheme). A boundary with the wrong parity is moved forward by one term. The batches must be in range order.
+*/
+double richardsonExtrapolate(const Parameter *param, int batches, double total, long long n)
+{
+    double x[RICHARDSON_LEVELS];
+    double y[RICHARDSON_LEVELS];
+    int points = 1;
+    x[0] = 1.0 / n;
+    y[0] = total;
+
+    // Running (compensated) prefix sum over the batches, walked once from the first batch up.
+    double prefix = 0;
+    double compensation = 0;
+    int b = 0;
+    long long boundary = 0;
+    for (int level = RICHARDSON_LEVELS - 1; level >= 1; level--)
+    {
+        long long target = n >> level;
+        while (b < batches && param[b].end <= target)
+        {
+            neumaierAdd(&prefix, &compensation, param[b].pi);
+            compensation += param[b].piError;
+            boundary = param[b].end;
+            b++;
+        }
+        double partial = prefix + compensation;
+        long long m = boundary;
+        if ((m & 1) != (n & 1))
+        {
+            partial += 4 * leibnizTerm(m);
+            m++;
+        }
+        // Skip levels that landed on the same boundary as the previous one, or on nothing at all.
+        if (m <= 1 || m >= n || (points > 1 && 1.0 / m == x[points - 1]))
+        {
+            continue;
+        }
+        x[points] = 1.0 / m;
+        y[points] = partial;
+        points++;
+    }
+
+    for (int k = 1; k < points; k++)
+    {
+        for (int i = 0; i + k < points; i++)
+        {
+            y[i] = (x[i] * y[i + 1] - x[i + k] * y[i]) / (x[i] - x[i + k]);
+        }
+    }
+    return y[0];
+}
+
+/* Splits the iterations into batches, runs them on the thread pool and adds the batch results together.
+   The caller has already checked that there are more iterations than batches. If 'result' is not NULL, the extended
+   precision value and the number of terms that were actually summed (fewer than the iterations if a tolerance was reached
+   early) are stored in it. Returns Pi as a double.
+*/
+double computePi(const RunSettings *settings, PiResult *result)
+{
+    int batches = settings->batches;
+    int numThreads = settings->threads;
+
+    // This section ensure that all threads will use 'equal' amount of processes.
+    // This is done by getting the amount of threads / total amount of iterations.
+    // First we needs to find what each thread will process each section of iterations equally.
+    long long batch_size = settings->iterations / batches;
+    // If there is an odd number, each one will be added from batch 0 onwards untill the amonut in remainder becomes 0.
+    long long remainder = settings->iterations % batches;
+
+    // Creating the foundation of variable that will be manupuated to store the range of iterations for each batch.
+    long long start = 0;
+    long long end = 0;
+    int index = 0;
+
+    // Struct that will store all the required variables, every batch on its own cache line.
+    Parameter *param = (Parameter *)aligned_alloc(CACHE_LINE, batches * sizeof(Parameter));
+    memset(param, 0, batches * sizeof(Parameter));
+    // Fixed-point numbers get enough 32-bit limbs for the digits asked for, plus a few guard limbs to soak up rounding.
+    int fixedLimbs = (int)ceil(settings->fixedDigits * 3.3219280948873623 / 32) + 3;
+    // The pool never needs more threads than there are batches.
+    if (numThreads > batches)
+    {
+        numThreads = batches;
+    }
+    pthread_t *threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+
+    /*
+        This loop iterates through each batch. For each iteration, it calculates the 'end' for the current batch by adding the 'batch_size' to the 'start'.
+        If there is a remainder, it increments the 'end' by 1 and decrements the 'remainder' by 1.
+        It then assigns the 'end', 'start', and 'batch' number to a parameter struct which is left in the queue for the thread pool.
+        The 'start' for the next iteration is then updated to the 'end' point of the current iteration and the 'index' is incremented.
+    */
+
+    // Loop through each batch.
+    for (int i = 0; i < batches; i++)
+    {
+        // End will be populated by the batchsize + start.
+        end = start + batch_size;
+        // any remainder will increment the end value by 1 for the current parameter and decrease the remainder value by 1.
+        if (remainder > 0)
+        {
+            remainder--;
+            end++;
+        }
+
+        // Fill the parameter
+        param[i].end = end;
+        param[i].start = start;
+        param[i].batch = index;
+        param[i].kernel = settings->kernel;
+        param[i].scale = settings->series->scale;
+        param[i].sumMode = settings->sumMode;
+        param[i].precision = settings->precision;
+        // The limbs are allocated by the worker that claims the batch, so they end up in memory local to its CPU.
+        param[i].sumFixed.limb = NULL;
+        param[i].sumFixed.count = fixedLimbs;
+
+        index++;
+        start = end;
+    }
+
+    // Start the pool, each thread pulls batches from the queue until there are none left.
+    BatchQueue queue;
+    queue.param = param;
+    queue.batches = batches;
+    queue.tolerance = settings->tolerance;
+    queue.series = settings->series;
+    atomic_init(&queue.nextBatch, 0);
+    atomic_init(&queue.stopBatch, batches);
+    atomic_init(&queue.finishedWorkers, 0);
+    // Deal the batches out in contiguous shares, pushed in reverse so each worker pops its share from the front.
+    queue.workers = numThreads;
+    queue.deques = (WorkDeque *)aligned_alloc(CACHE_LINE, numThreads * sizeof(WorkDeque));
+    for (int w = 0; w < numThreads; w++)
+    {
+        dequeInit(&queue.deques[w]);
+        if (settings->tolerance == 0)
+        {
+            int first = (int)((long long)batches * w / numThreads);
+            int last = (int)((long long)batches * (w + 1) / numThreads);
+            for (int i = last - 1; i >= first; i--)
+            {
+                dequePush(&queue.deques[w], &param[i]);
+            }
+        }
+    }
+
+    // One cache line sized slot per worker.
+    WorkerSlot *slots = (WorkerSlot *)aligned_alloc(CACHE_LINE, numThreads * sizeof(WorkerSlot));
+    for (int i = 0; i < numThreads; i++)
+    {
+        atomic_init(&slots[i].termsDone, 0);
+        atomic_init(&slots[i].batchesDone, 0);
+        atomic_init(&slots[i].batchesStolen, 0);
+        slots[i].worker = i;
+        slots[i].queue = &queue;
+        pthread_attr_t attr;
+        affinityAttr(&attr, settings->cpus, settings->cpuCount, i);
+        pthread_create(threads + i, &attr, poolWorker, (void *)&slots[i]);
+        pthread_attr_destroy(&attr);
+    }
+
+    // While the pool runs the main thread can report progress, it only reads the worker slots.
+    if (settings->progress)
+    {
+        struct timespec wait = {0, 200000000};
+        while (atomic_load(&queue.finishedWorkers) < numThreads)
+        {
+            long long done = reduceProgress(slots, numThreads);
+            // With a tolerance the run can stop early, so the iterations are only an upper limit and a percentage would be misleading.
+            if (settings->tolerance > 0)
+            {
+                fprintf(stderr, "\rProgress: %lld terms", done);
+            }
+            else
+            {
+                fprintf(stderr, "\rProgress: %lld terms (%.1f%%)", done, 100.0 * done / settings->iterations);
+            }
+            nanosleep(&wait, NULL);
+        }
+        fprintf(stderr, "\rProgress: %lld terms (done)    \n", reduceProgress(slots, numThreads));
+    }
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        dequeFree(&queue.deques[i]);
+    }
+    free(queue.deques);
+
+    // Only the batches that were handed out count, they always cover the range from 0 up to 'used'.
+    int usedBatches = atomic_load(&queue.stopBatch);
+    long long used = param[usedBatches - 1].end;
+    double truestPi = 0;
+
+    if (settings->precision != PREC_DOUBLE)
+    {
+        // Extended precision: reduce the batch sums, add the Euler tail if asked for, then multiply by 4.
+        reduceWide(param, usedBatches, numThreads);
+        if (settings->precision == PREC_LONG_DOUBLE)
+        {
+            long double sum = param[0].sumLong + (settings->accel == ACCEL_EULER ? eulerTailLong(used) : 0);
+            truestPi = (double)(4 * sum);
+            if (result != NULL)
+            {
+                result->piLong = 4 * sum;
+            }
+        }
+        else if (settings->precision == PREC_QUAD)
+        {
+            __float128 sum = param[0].sumQuad + (settings->accel == ACCEL_EULER ? eulerTailQuad(used) : 0);
+            truestPi = (double)(4 * sum);
+            if (result != NULL)
+            {
+                result->piQuad = 4 * sum;
+            }
+        }
+        else
+        {
+            FixedNum *sum = &param[0].sumFixed;
+            if (settings->accel == ACCEL_EULER)
+            {
+                eulerTailFixed(sum, used);
+            }
+            fixedMulSmall(sum, 4);
+            truestPi = sum->limb[0] + sum->limb[1] / 4294967296.0;
+            if (result != NULL)
+            {
+                // Hand the reduced number over to the result instead of copying it.
+                result->piFixed = *sum;
+                sum->limb = NULL;
+            }
+            for (int i = 0; i < batches; i++)
+            {
+                fixedFree(&param[i].sumFixed);
+            }
+        }
+    }
+    else
+    {
+        truestPi = reduceBatches(param, usedBatches, settings->sumMode);
+
+        // Optional acceleration of the partial sum.
+        if (settings->accel == ACCEL_EULER)
+        {
+            truestPi += eulerTail(used);
+        }
+        else if (settings->accel == ACCEL_AITKEN)
+        {
+            truestPi = aitkenExtrapolate(truestPi, used);
+        }
+        else if (settings->accel == ACCEL_RICHARDSON)
+        {
+            truestPi = richardsonExtrapolate(param, usedBatches, truestPi, used);
+        }
+        truestPi = settings->series->finish(truestPi);
+    }
+    if (result != NULL)
+    {
+        result->pi = truestPi;
+        result->termsUsed = used;
+        result->workers = numThreads;
+        result->workerChunks = (int *)malloc(numThreads * sizeof(int));
+        result->workerSteals = (int *)malloc(numThreads * sizeof(int));
+        for (int i = 0; i < numThreads; i++)
+        {
+            result->workerChunks[i] = atomic_load(&slots[i].batchesDone);
+            result->workerSteals[i] = atomic_load(&slots[i].batchesStolen);
+        }
+    }
+
+    // Freeing allocated memory.
+    free(param);
+    free(slots);
+    free(threads);
+    return truestPi;
+}
+
+// Reads the monotonic clock in seconds, used for timing runs.
+double secondsNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* The exact value of 4 * (the first n terms of the series), worked out in long double. Small n are summed directly and larger n
+   use the expansion Pi - 4 S(n) = (-1)^n (1/n - 1/(4n^3) + 5/(16n^5) - 61/(64n^7) + ...), whose coefficients come from the Euler numbers.
+   This lets the benchmark tell the rounding error of a summation mode apart from the error of stopping the series after n terms.
+*/
+long double truncatedLeibniz(long long n)
+{
+    const long double pi = 3.14159265358979323846264338327950288L;
+    if (n < 1000)
+    {
+        long double sum = 0;
+        for (long long i = 0; i < n; i++)
+        {
+            sum += ((i & 1) ? -4.0L : 4.0L) / (2.0L * i + 1);
+        }
+        return sum;
+    }
+    long double x = 1.0L / n;
+    long double x2 = x * x;
+    long double tail = x * (1 - x2 * (0.25L - x2 * (5.0L / 16 - x2 * (61.0L / 64 - x2 * 1385.0L / 256))));
+    return (n & 1) ? pi + tail : pi - tail;
+}
+
+/* Runs the same calculation once with every summation mode and prints how long each took, its rounding error (compared with the
+   exact value of the truncated series) and its total error compared with Pi. With acceleration, or for a series other than Leibniz,
+   there is no exact truncated value to compare with, so the rounding error column is then measured against Pi as well.
+*/
+void sumBenchmark(RunSettings settings)
+{
+    const long double pi = 3.14159265358979323846264338327950288L;
+    const char *names[] = {"naive", "neumaier", "pairwise"};
+
+    printf("Mode\tSeconds\tPi\tRounding error\tError vs Pi\n");
+    for (int mode = SUM_NAIVE; mode <= SUM_PAIRWISE; mode++)
+    {
+        PiResult run;
+        settings.sumMode = (SumMode)mode;
+        double startTime = secondsNow();
+        double result = computePi(&settings, &run);
+        double elapsed = secondsNow() - startTime;
+        long double exact = (settings.accel == ACCEL_NONE && settings.series == &seriesList[0]) ? truncatedLeibniz(run.termsUsed) : pi;
+        printf("%s\t%.6f\t%.17f\t%.3Le\t%.3Le\n", names[mode], elapsed, result, result - exact, result - pi);
+        free(run.workerChunks);
+        free(run.workerSteals);
+    }
+}
+
+/* Reads a count from the command line. Plain integers are read exactly and scientific notation such as 1e12 is also accepted
+   as long as it is a whole number. The count is capped at 2^52 so that every denominator 2i + 1 is still exact as a double.
+   Returns -1 if the text is not a valid count.
+*/
+long long parseCount(const char *text)
+{
+    char *endptr;
+    long long count = strtoll(text, &endptr, 10);
+
+    // Fall back to strtod for things like 1e12 or 2.5e9.
+    if (*endptr == '.' || *endptr == 'e' || *endptr == 'E')
+    {
+        double value = strtod(text, &endptr);
+        if (value != floor(value) || value > (double)(1LL << 52))
+        {
+            return -1;
+        }
+        count = (long long)value;
+    }
+    if (endptr == text || *endptr != '\0' || count < 0 || count > (1LL << 52))
+    {
+        return -1;
+    }
+    return count;
+}
+
+/* Runs every series with the same iterations, batches and threads and prints how many correct digits each reached, and how
+   many digits per second that works out to. A double holds about 16 digits, so that is where the count stops.
+*/
+void seriesBenchmark(RunSettings settings, const char *kernelName)
+{
+    const long double pi = 3.14159265358979323846264338327950288L;
+    printf("Series\tKernel\tTerms\tSeconds\tPi\tError\tDigits\tDigits/sec\n");
+    for (int i = 0; i < SERIES_COUNT; i++)
+    {
+        const char *label = NULL;
+        PiResult run;
+        settings.series = &seriesList[i];
+        settings.kernel = selectKernel(settings.series, kernelName, &label);
+        // The acceleration methods are written for the Leibniz series only.
+        if (i != 0)
+        {
+            settings.accel = ACCEL_NONE;
+        }
+
+        double startTime = secondsNow();
+        double result = computePi(&settings, &run);
+        double elapsed = secondsNow() - startTime;
+        long double error = fabsl(result - pi);
+        double digits = (error > 0) ? -log10((double)error) : 16;
+        if (digits > 16)
+        {
+            digits = 16;
+        }
+        if (digits < 0)
+        {
+            digits = 0;
+        }
+        printf("%s\t%s\t%lld\t%.6f\t%.17f\t%.3Le\t%.1f\t%.3e\n", settings.series->name, label, run.termsUsed, elapsed, result,
+               error, digits, digits / elapsed);
+        free(run.workerChunks);
+        free(run.workerSteals);
+    }
+}
+
+// Terms every SIMD kernel is checked over by --kernel-check. Past 2^20 the terms are far below the ulp of the running sum, which
+// is where a kernel that loses its rounding errors drifts away from the scalar one.
+#define KERNEL_CHECK_TERMS ((3LL << 20) + 5)
+
+/* --kernel-check: runs every SIMD kernel the CPU supports and the scalar kernel of the same series over KERNEL_CHECK_TERMS terms,
+   from an odd first term so the kernels' scalar lead-in and tail are used too. Both are compared with a reference that adds the
+   terms one by one in long double, so the rounding of the running sum does not count. A SIMD kernel fails when it is further
+   from the reference than the scalar kernel is, give or take 1e-15 in Pi. The difference to the scalar kernel is printed as well.
+   Returns the number of kernels that failed.
+*/
+int kernelCheck(void)
+{
+    __builtin_cpu_init();
+    int failures = 0;
+    printf("Series\tKernel\tVsScalar\tError\tScalarError\tResult\n");
+    for (int i = 0; i < SERIES_COUNT; i++)
+    {
+        const Series *series = &seriesList[i];
+        const char *names[2] = {"avx2", "avx512"};
+        SeriesKernel kernels[2] = {series->avx2, series->avx512};
+        int supported[2] = {__builtin_cpu_supports("avx2"), __builtin_cpu_supports("avx512f")};
+        if ((kernels[0] == NULL || !supported[0]) && (kernels[1] == NULL || !supported[1]))
+        {
+            continue;
+        }
+        long double reference = 0;
+        for (long long k = 1; k < KERNEL_CHECK_TERMS; k++)
+        {
+            reference += series->scalar(k, k + 1);
+        }
+        double scalar = series->scalar(1, KERNEL_CHECK_TERMS);
+        double scalarError = (double)fabsl(scalar - reference) * series->scale;
+        for (int j = 0; j < 2; j++)
+        {
+            if (kernels[j] == NULL || !supported[j])
+            {
+                continue;
+            }
+            double simd = kernels[j](1, KERNEL_CHECK_TERMS);
+            double error = (double)fabsl(simd - reference) * series->scale;
+            int failed = !(error <= scalarError + 1e-15);
+            failures += failed;
+            printf("%s\t%s\t%.3e\t%.3e\t%.3e\t%s\n", series->name, names[j], fabs(simd - scalar) * series->scale, error, scalarError,
+                   failed ? "FAIL" : "ok");
+        }
+    }
+    return failures;
+}
+
+/* Everything below is for --pi-digits, which works out millions of digits of Pi with the Chudnovsky series on big integers.
+   The big integers are kept in base 10^9 (nine decimal digits per 32-bit limb), so the decimal digits can be streamed straight
+   out of the limbs at the end without a base conversion. Short products use the schoolbook method and long ones a number
+   theoretic transform (NTT) modulo three primes, put back together with the Chinese remainder theorem.
+*/
+
+// Base of the big integers and how many decimal digits each limb holds.
+#define BIG_BASE 1000000000u
+#define BIG_DIGITS 9
+// Below this many limbs in the shorter factor the schoolbook multiplication is faster than the transforms.
+#define BIG_SCHOOLBOOK 48
+// Products of at least this many limbs run the transform of each prime on its own thread.
+#define BIG_PARALLEL (1 << 15)
+// The three NTT primes, 3 is a primitive root of each of them. The first one limits the transform length to 2^23.
+#define NTT_PRIME1 998244353u
+#define NTT_PRIME2 167772161u
+#define NTT_PRIME3 469762049u
+#define NTT_MAX_LENGTH (1 << 23)
+// Ranges of at most this many Chudnovsky terms are split on the current thread instead of going on the work-stealing deques.
+#define SPLIT_GRAIN 64
+// Each Chudnovsky term adds log10(640320^3 / 1728) digits.
+#define CHUDNOVSKY_DIGITS_PER_TERM 14.181647462725477
+// The transform length caps the products at about 75 million digits, the largest product is a bit over twice the digits asked for.
+#define PI_DIGITS_MAX 30000000LL
+
+/* Signed big integer. limb[0] is the least significant limb and limb[size - 1] is never 0, so 0 has size 0.
+*/
+typedef struct
+{
+    uint32_t *limb;
+    int size;
+    int capacity;
+    int negative;
+} BigInt;
+
+/* Big floating point number for the division and square root at the end, the value is mantissa * 10^(9 * exponent).
+*/
+typedef struct
+{
+    BigInt mantissa;
+    long long exponent;
+} BigFloat;
+
+// Threads each big multiplication may use for its three transforms, set from --threads.
+int bigMulThreads = 1;
+
+void bigInit(BigInt *x)
+{
+    x->limb = NULL;
+    x->size = 0;
+    x->capacity = 0;
+    x->negative = 0;
+}
+
+void bigFree(BigInt *x)
+{
+    free(x->limb);
+    bigInit(x);
+}
+
+// Makes room for at least 'capacity' limbs and keeps the ones already there.
+void bigReserve(BigInt *x, int capacity)
+{
+    if (capacity > x->capacity)
+    {
+        x->limb = (uint32_t *)realloc(x->limb, (size_t)capacity * sizeof(uint32_t));
+        x->capacity = capacity;
+    }
+}
+
+// Drops the zero limbs at the top. 0 is never negative.
+void bigTrim(BigInt *x)
+{
+    while (x->size > 0 && x->limb[x->size - 1] == 0)
+    {
+        x->size--;
+    }
+    if (x->size == 0)
+    {
+        x->negative = 0;
+    }
+}
+
+void bigSetSmall(BigInt *x, uint64_t value)
+{
+    bigReserve(x, 3);
+    x->size = 0;
+    x->negative = 0;
+    while (value > 0)
+    {
+        x->limb[x->size++] = (uint32_t)(value % BIG_BASE);
+        value /= BIG_BASE;
+    }
+}
+
+void bigCopy(BigInt *dst, const BigInt *src)
+{
+    bigReserve(dst, src->size + 1);
+    memcpy(dst->limb, src->limb, (size_t)src->size * sizeof(uint32_t));
+    dst->size = src->size;
+    dst->negative = src->negative;
+}
+
+// x *= m
+void bigMulSmall(BigInt *x, uint32_t m)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < x->size; i++)
+    {
+        uint64_t current = (uint64_t)x->limb[i] * m + carry;
+        x->limb[i] = (uint32_t)(current % BIG_BASE);
+        carry = current / BIG_BASE;
+    }
+    while (carry > 0)
+    {
+        bigReserve(x, x->size + 1);
+        x->limb[x->size++] = (uint32_t)(carry % BIG_BASE);
+        carry /= BIG_BASE;
+    }
+    bigTrim(x);
+}
+
+int bigCompareMagnitude(const BigInt *a, const BigInt *b)
+{
+    if (a->size != b->size)
+    {
+        return a->size < b->size ? -1 : 1;
+    }
+    for (int i = a->size - 1; i >= 0; i--)
+    {
+        if (a->limb[i] != b->limb[i])
+        {
+            return a->limb[i] < b->limb[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r = |a| + |b|, r may be a or b.
+void bigAddMagnitude(BigInt *r, const BigInt *a, const BigInt *b)
+{
+    if (a->size < b->size)
+    {
+        const BigInt *swap = a;
+        a = b;
+        b = swap;
+    }
+    int longer = a->size;
+    int shorter = b->size;
+    bigReserve(r, longer + 1);
+    uint32_t carry = 0;
+    for (int i = 0; i < longer; i++)
+    {
+        uint32_t sum = a->limb[i] + (i < shorter ? b->limb[i] : 0) + carry;
+        carry = sum >= BIG_BASE;
+        r->limb[i] = carry ? sum - BIG_BASE : sum;
+    }
+    r->limb[longer] = carry;
+    r->size = longer + 1;
+}
+
+// r = |a| - |b| for |a| >= |b|, r may be a or b.
+void bigSubMagnitude(BigInt *r, const BigInt *a, const BigInt *b)
+{
+    int longer = a->size;
+    int shorter = b->size;
+    bigReserve(r, longer + 1);
+    uint32_t borrow = 0;
+    for (int i = 0; i < longer; i++)
+    {
+        uint32_t take = (i < shorter ? b->limb[i] : 0) + borrow;
+        borrow = a->limb[i] < take;
+        r->limb[i] = borrow ? a->limb[i] + BIG_BASE - take : a->limb[i] - take;
+    }
+    r->size = longer;
+}
+
+// r = a + b, or r = a - b when 'subtract' is set. r may be a or b.
+void bigAddSigned(BigInt *r, const BigInt *a, const BigInt *b, int subtract)
+{
+    int negativeA = a->negative;
+    int negativeB = (b->size > 0) && (b->negative != subtract);
+    if (negativeA == negativeB)
+    {
+        bigAddMagnitude(r, a, b);
+        r->negative = negativeA;
+    }
+    else if (bigCompareMagnitude(a, b) >= 0)
+    {
+        bigSubMagnitude(r, a, b);
+        r->negative = negativeA;
+    }
+    else
+    {
+        bigSubMagnitude(r, b, a);
+        r->negative = negativeB;
+    }
+    bigTrim(r);
+}
+
+static inline __attribute__((always_inline)) uint32_t nttPow(uint32_t base, uint32_t exponent, const uint32_t mod)
+{
+    uint64_t result = 1;
+    uint64_t power = base;
+    while (exponent > 0)
+    {
+        if (exponent & 1)
+        {
+            result = result * power % mod;
+        }
+        power = power * power % mod;
+        exponent >>= 1;
+    }
+    return (uint32_t)result;
+}
+
+/* In-place transform of 'a' (n values, n a power of two) modulo 'mod', or the inverse transform when 'invert' is set.
+   'twiddle' is scratch space for n / 2 values. It is always inlined with a constant 'mod' so the compiler can turn every
+   % mod into a multiplication.
+*/
+static inline __attribute__((always_inline)) void nttTransform(uint32_t *a, uint32_t *twiddle, int n, int invert, const uint32_t mod)
+{
+    for (int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            uint32_t swap = a[i];
+            a[i] = a[j];
+            a[j] = swap;
+        }
+    }
+
+    for (int length = 2; length <= n; length <<= 1)
+    {
+        int half = length >> 1;
+        uint32_t step = nttPow(3, (mod - 1) / length, mod);
+        if (invert)
+        {
+            step = nttPow(step, mod - 2, mod);
+        }
+        twiddle[0] = 1;
+        for (int j = 1; j < half; j++)
+        {
+            twiddle[j] = (uint32_t)((uint64_t)twiddle[j - 1] * step % mod);
+        }
+        for (int i = 0; i < n; i += length)
+        {
+            for (int j = 0; j < half; j++)
+            {
+                uint32_t u = a[i + j];
+                uint32_t v = (uint32_t)((uint64_t)a[i + j + half] * twiddle[j] % mod);
+                a[i + j] = (u + v >= mod) ? u + v - mod : u + v;
+                a[i + j + half] = (u >= v) ? u - v : u + mod - v;
+            }
+        }
+    }
+
+    if (invert)
+    {
+        uint64_t scale = nttPow((uint32_t)n, mod - 2, mod);
+        for (int i = 0; i < n; i++)
+        {
+            a[i] = (uint32_t)(a[i] * scale % mod);
+        }
+    }
+}
+
+// Cyclic convolution of the limbs of a and b modulo 'mod', written to 'out' (n values).
+static inline __attribute__((always_inline)) void nttConvolve(const BigInt *a, const BigInt *b, uint32_t *out, int n, const uint32_t mod)
+{
+    uint32_t *twiddle = (uint32_t *)malloc((size_t)(n / 2) * sizeof(uint32_t));
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = (i < a->size) ? a->limb[i] % mod : 0;
+    }
+    nttTransform(out, twiddle, n, 0, mod);
+
+    // Squaring only needs one forward transform.
+    if (a == b)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            out[i] = (uint32_t)((uint64_t)out[i] * out[i] % mod);
+        }
+    }
+    else
+    {
+        uint32_t *other = (uint32_t *)malloc((size_t)n * sizeof(uint32_t));
+        for (int i = 0; i < n; i++)
+        {
+            other[i] = (i < b->size) ? b->limb[i] % mod : 0;
+        }
+        nttTransform(other, twiddle, n, 0, mod);
+        for (int i = 0; i < n; i++)
+        {
+            out[i] = (uint32_t)((uint64_t)out[i] * other[i] % mod);
+        }
+        free(other);
+    }
+    nttTransform(out, twiddle, n, 1, mod);
+    free(twiddle);
+}
+
+// One transform of a big multiplication, so the three primes can run on separate threads.
 typedef struct
 {
-    int *array;
-    int batch;
-    double pi;
-    int start;
-    int end;
-} Parameter;
+    const BigInt *a;
+    const BigInt *b;
+    uint32_t *out;
+    int n;
+    int prime;
+} NttJob;
+
+void *nttJobWorker(void *j)
+{
+    NttJob *job = (NttJob *)j;
+    if (job->prime == 0)
+    {
+        nttConvolve(job->a, job->b, job->out, job->n, NTT_PRIME1);
+    }
+    else if (job->prime == 1)
+    {
+        nttConvolve(job->a, job->b, job->out, job->n, NTT_PRIME2);
+    }
+    else
+    {
+        nttConvolve(job->a, job->b, job->out, job->n, NTT_PRIME3);
+    }
+    return NULL;
+}
+
+/* Writes the a->size + b->size limbs of |a * b| into 'out'. Every limb of the convolution is below n * 10^18, which is less than
+   the product of the three primes, so the residues give back the exact value through Garner's form of the Chinese remainder theorem.
+*/
+void nttMultiply(const BigInt *a, const BigInt *b, uint32_t *out)
+{
+    int size = a->size + b->size;
+    int n = 1;
+    while (n < size - 1)
+    {
+        n <<= 1;
+    }
+    if (n > NTT_MAX_LENGTH)
+    {
+        printf("The numbers are too long for the transform (%d limbs).\n", size);
+        exit(1);
+    }
+
+    NttJob jobs[3];
+    pthread_t threads[3];
+    for (int p = 0; p < 3; p++)
+    {
+        jobs[p].a = a;
+        jobs[p].b = b;
+        jobs[p].out = (uint32_t *)malloc((size_t)n * sizeof(uint32_t));
+        jobs[p].n = n;
+        jobs[p].prime = p;
+    }
+    if (bigMulThreads > 1 && size >= BIG_PARALLEL)
+    {
+        for (int p = 1; p < 3; p++)
+        {
+            pthread_create(&threads[p], NULL, nttJobWorker, &jobs[p]);
+        }
+        nttJobWorker(&jobs[0]);
+        for (int p = 1; p < 3; p++)
+        {
+            pthread_join(threads[p], NULL);
+        }
+    }
+    else
+    {
+        for (int p = 0; p < 3; p++)
+        {
+            nttJobWorker(&jobs[p]);
+        }
+    }
+
+    const uint64_t p1 = NTT_PRIME1;
+    const uint64_t p2 = NTT_PRIME2;
+    const uint64_t p3 = NTT_PRIME3;
+    const uint64_t p1p2 = p1 * p2;
+    const uint64_t inverse1 = nttPow((uint32_t)(p1 % p2), NTT_PRIME2 - 2, NTT_PRIME2);
+    const uint64_t inverse12 = nttPow((uint32_t)(p1p2 % p3), NTT_PRIME3 - 2, NTT_PRIME3);
+    unsigned __int128 carry = 0;
+    for (int i = 0; i < size; i++)
+    {
+        unsigned __int128 value = carry;
+        if (i < size - 1)
+        {
+            uint64_t x1 = jobs[0].out[i];
+            uint64_t t2 = (jobs[1].out[i] + p2 - x1 % p2) % p2 * inverse1 % p2;
+            uint64_t x12 = x1 + p1 * t2;
+            uint64_t t3 = (jobs[2].out[i] + p3 - x12 % p3) % p3 * inverse12 % p3;
+            value += x12 + (unsigned __int128)p1p2 * t3;
+        }
+        // Long division by 10^9 in 32-bit pieces, so every step is a 64-bit division by a constant instead of a 128-bit library call.
+        uint64_t top = (uint64_t)(value >> 64);
+        uint64_t middle = ((top % BIG_BASE) << 32) | (uint32_t)(value >> 32);
+        uint64_t bottom = ((middle % BIG_BASE) << 32) | (uint32_t)value;
+        out[i] = (uint32_t)(bottom % BIG_BASE);
+        carry = ((unsigned __int128)(top / BIG_BASE) << 64) | ((middle / BIG_BASE) << 32 | bottom / BIG_BASE);
+    }
+    for (int p = 0; p < 3; p++)
+    {
+        free(jobs[p].out);
+    }
+}
+
+// r = a * b, r may be a or b.
+void bigMul(BigInt *r, const BigInt *a, const BigInt *b)
+{
+    if (a->size == 0 || b->size == 0)
+    {
+        r->size = 0;
+        r->negative = 0;
+        return;
+    }
+    int size = a->size + b->size;
+    int negative = a->negative != b->negative;
+    uint32_t *out = (uint32_t *)calloc((size_t)size, sizeof(uint32_t));
+
+    if ((a->size < b->size ? a->size : b->size) < BIG_SCHOOLBOOK)
+    {
+        for (int i = 0; i < a->size; i++)
+        {
+            uint64_t carry = 0;
+            uint64_t digit = a->limb[i];
+            for (int j = 0; j < b->size; j++)
+            {
+                uint64_t current = out[i + j] + digit * b->limb[j] + carry;
+                out[i + j] = (uint32_t)(current % BIG_BASE);
+                carry = current / BIG_BASE;
+            }
+            out[i + b->size] = (uint32_t)carry;
+        }
+    }
+    else
+    {
+        nttMultiply(a, b, out);
+    }
+
+    free(r->limb);
+    r->limb = out;
+    r->size = size;
+    r->capacity = size;
+    r->negative = negative;
+    bigTrim(r);
+}
+
+void floatInit(BigFloat *x)
+{
+    bigInit(&x->mantissa);
+    x->exponent = 0;
+}
+
+void floatFree(BigFloat *x)
+{
+    bigFree(&x->mantissa);
+}
+
+// Keeps the 'limbs' most significant limbs of x and drops the rest.
+void floatTruncate(BigFloat *x, int limbs)
+{
+    int drop = x->mantissa.size - limbs;
+    if (drop > 0)
+    {
+        memmove(x->mantissa.limb, x->mantissa.limb + drop, (size_t)limbs * sizeof(uint32_t));
+        x->mantissa.size = limbs;
+        x->exponent += drop;
+    }
+}
+
+// r = a * b to 'limbs' limbs, r may be a or b.
+void floatMul(BigFloat *r, const BigFloat *a, const BigFloat *b, int limbs)
+{
+    long long exponent = a->exponent + b->exponent;
+    bigMul(&r->mantissa, &a->mantissa, &b->mantissa);
+    r->exponent = exponent;
+    floatTruncate(r, limbs);
+}
+
+// Copies x into 'out' with the mantissa moved up by 'shift' limbs, so it can be added to a number with a smaller exponent.
+void floatAlign(BigInt *out, const BigFloat *x, long long shift)
+{
+    bigReserve(out, x->mantissa.size + (int)shift + 1);
+    memset(out->limb, 0, (size_t)shift * sizeof(uint32_t));
+    memcpy(out->limb + shift, x->mantissa.limb, (size_t)x->mantissa.size * sizeof(uint32_t));
+    out->size = x->mantissa.size + (int)shift;
+    out->negative = x->mantissa.negative;
+}
+
+// r = a + b, or r = a - b when 'subtract' is set, to 'limbs' limbs. r may be a or b.
+void floatAdd(BigFloat *r, const BigFloat *a, const BigFloat *b, int subtract, int limbs)
+{
+    BigInt x;
+    BigInt y;
+    bigInit(&x);
+    bigInit(&y);
+    long long exponent = a->exponent < b->exponent ? a->exponent : b->exponent;
+    // A zero mantissa can have any exponent, so it must not decide where the other number is lined up.
+    if (a->mantissa.size == 0)
+    {
+        exponent = b->exponent;
+    }
+    else if (b->mantissa.size == 0)
+    {
+        exponent = a->exponent;
+    }
+    if (a->mantissa.size > 0)
+    {
+        floatAlign(&x, a, a->exponent - exponent);
+    }
+    if (b->mantissa.size > 0)
+    {
+        floatAlign(&y, b, b->exponent - exponent);
+    }
+    bigAddSigned(&r->mantissa, &x, &y, subtract);
+    r->exponent = exponent;
+    floatTruncate(r, limbs);
+    bigFree(&x);
+    bigFree(&y);
+}
+
+// x /= 2, done as x * 5 * 10^8 / 10^9 so nothing is lost.
+void floatHalve(BigFloat *x)
+{
+    bigMulSmall(&x->mantissa, BIG_BASE / 2);
+    x->exponent -= 1;
+}
+
+/* r = 1 / d to 'limbs' limbs with Newton's iteration y = y + y (1 - d y). The start value comes from the top two limbs of d in
+   long double and every step doubles the number of correct limbs, so the steps run at 2, 4, 8, ... limbs and only the last
+   one costs a full length multiplication.
+*/
+void floatReciprocal(BigFloat *r, const BigFloat *d, int limbs)
+{
+    const BigInt *m = &d->mantissa;
+    long double top = m->limb[m->size - 1];
+    long long topExponent = d->exponent + m->size - 1;
+    long double scale = (long double)BIG_BASE * BIG_BASE;
+    if (m->size > 1)
+    {
+        top = top * BIG_BASE + m->limb[m->size - 2];
+        topExponent--;
+        scale *= BIG_BASE;
+    }
+    // 1 / d = (scale / top) * 10^(-9 * (topExponent + log(scale))), and scale / top is below 10^18 either way.
+    bigSetSmall(&r->mantissa, (uint64_t)(scale / top));
+    r->mantissa.negative = m->negative;
+    r->exponent = -topExponent - (m->size > 1 ? 3 : 2);
+
+    BigFloat one;
+    BigFloat part;
+    BigFloat shortD;
+    floatInit(&one);
+    floatInit(&part);
+    floatInit(&shortD);
+    bigSetSmall(&one.mantissa, 1);
+    int precision = 1;
+    while (precision < limbs)
+    {
+        precision = (2 * precision < limbs) ? 2 * precision : limbs;
+        int work = precision + 2;
+        bigCopy(&shortD.mantissa, &d->mantissa);
+        shortD.exponent = d->exponent;
+        floatTruncate(&shortD, work);
+        floatMul(&part, &shortD, r, work);
+        floatAdd(&part, &one, &part, 1, work);
+        floatMul(&part, r, &part, work);
+        floatAdd(r, r, &part, 0, work);
+    }
+    floatFree(&one);
+    floatFree(&part);
+    floatFree(&shortD);
+}
+
+/* r = 1 / sqrt(x) to 'limbs' limbs with Newton's iteration y = y + y (1 - x y^2) / 2, which needs no division at all.
+*/
+void floatInverseSqrt(BigFloat *r, uint32_t x, int limbs)
+{
+    long double start = 1.0L / sqrtl((long double)x);
+    bigSetSmall(&r->mantissa, (uint64_t)(start * BIG_BASE * BIG_BASE));
+    r->exponent = -2;
+
+    BigFloat value;
+    BigFloat part;
+    floatInit(&value);
+    floatInit(&part);
+    BigFloat one;
+    floatInit(&one);
+    bigSetSmall(&one.mantissa, 1);
+    bigSetSmall(&value.mantissa, x);
+    int precision = 1;
+    while (precision < limbs)
+    {
+        precision = (2 * precision < limbs) ? 2 * precision : limbs;
+        int work = precision + 2;
+        floatMul(&part, r, r, work);
+        floatMul(&part, &value, &part, work);
+        floatAdd(&part, &one, &part, 1, work);
+        floatMul(&part, r, &part, work);
+        floatHalve(&part);
+        floatAdd(r, r, &part, 0, work);
+    }
+    floatFree(&value);
+    floatFree(&part);
+    floatFree(&one);
+}
+
+/* P, Q and T of a single Chudnovsky term k:
+   P = (6k - 5)(2k - 1)(6k - 1), Q = k^3 640320^3 / 24 and T = (-1)^k P (13591409 + 545140134 k), with P = Q = 1 for k = 0.
+*/
+void chudnovskyTerm(long long k, BigInt *P, BigInt *Q, BigInt *T)
+{
+    if (k == 0)
+    {
+        bigSetSmall(P, 1);
+        bigSetSmall(Q, 1);
+        bigSetSmall(T, 13591409);
+        return;
+    }
+    bigSetSmall(P, (uint64_t)(6 * k - 5) * (uint64_t)(2 * k - 1));
+    bigMulSmall(P, (uint32_t)(6 * k - 1));
+    // 640320^3 / 24 = 640320 * 640320 * 26680
+    bigSetSmall(Q, (uint64_t)k * (uint64_t)k);
+    bigMulSmall(Q, (uint32_t)k);
+    bigMulSmall(Q, 640320);
+    bigMulSmall(Q, 640320);
+    bigMulSmall(Q, 26680);
+    BigInt linear;
+    bigInit(&linear);
+    bigSetSmall(&linear, 13591409 + 545140134ULL * (uint64_t)k);
+    bigMul(T, P, &linear);
+    bigFree(&linear);
+    T->negative = (k & 1);
+}
 
-/* The leibnizFormula function calculates the sum of the Leibniz formula applied to each element in an array within a specified range.
-   It then stores the result in the pi member of a parameter struct.
-   For testing purposes I added printf for the batch number, start and end points, index, and value of each element in the array to gain better understanding of each process for each batch.
+/* Puts the results of [a, m) (P, Q, T) and [m, b) (P2, Q2, T2) together into P, Q and T of [a, b):
+   P = P P2, Q = Q Q2 and T = T Q2 + P T2. P is only needed when something further left will use it.
 */
+void chudnovskyMerge(BigInt *P, BigInt *Q, BigInt *T, BigInt *P2, BigInt *Q2, BigInt *T2, int needP)
+{
+    bigMul(T, T, Q2);
+    bigMul(T2, P, T2);
+    bigAddSigned(T, T, T2, 0);
+    bigMul(Q, Q, Q2);
+    if (needP)
+    {
+        bigMul(P, P, P2);
+    }
+}
 
-void *leibnizFormula(void *p)
+// Binary splitting of [a, b) on the current thread.
+void chudnovskySplitSerial(long long a, long long b, int needP, BigInt *P, BigInt *Q, BigInt *T)
 {
-    Parameter *param = (Parameter *)p;
-    double term = 0, sum = 0;
+    if (b - a == 1)
+    {
+        chudnovskyTerm(a, P, Q, T);
+        return;
+    }
+    long long m = (a + b) / 2;
+    BigInt P2;
+    BigInt Q2;
+    BigInt T2;
+    bigInit(&P2);
+    bigInit(&Q2);
+    bigInit(&T2);
+    chudnovskySplitSerial(a, m, 1, P, Q, T);
+    chudnovskySplitSerial(m, b, needP, &P2, &Q2, &T2);
+    chudnovskyMerge(P, Q, T, &P2, &Q2, &T2, needP);
+    bigFree(&P2);
+    bigFree(&Q2);
+    bigFree(&T2);
+}
 
-    /* Applying Leibniz Formula */
-    for (int i = param->start; i < param->end; i++)
+/* A subtree [a, b) of the binary splitting waiting on a deque. 'done' is set once P, Q and T are ready.
+*/
+typedef struct
+{
+    long long a;
+    long long b;
+    int needP;
+    BigInt P;
+    BigInt Q;
+    BigInt T;
+    atomic_int done;
+} SplitTask;
+
+typedef struct
+{
+    WorkDeque *deques;
+    int workers;
+    atomic_int finished;
+    atomic_llong steals;
+} SplitPool;
+
+typedef struct
+{
+    SplitPool *pool;
+    int worker;
+} SplitWorker;
+
+// Takes a task from the worker's own deque, or steals the oldest task of another worker.
+SplitTask *splitFindTask(SplitPool *pool, int worker)
+{
+    SplitTask *task = (SplitTask *)dequePop(&pool->deques[worker]);
+    for (int i = 1; task == NULL && i < pool->workers; i++)
     {
-        // printf("Batch number: %d\n", param->batch);
-        // printf("Start:%d\tEnd:%d\tIndex:%d\tValue:%d\n", param->start, param->end, param->batch, param->array[i]);
-        term = pow(-1, i) / (2 * i + 1);
-        sum += term;
+        task = (SplitTask *)dequeSteal(&pool->deques[(worker + i) % pool->workers]);
+        if (task != NULL)
+        {
+            atomic_fetch_add(&pool->steals, 1);
+        }
     }
-    int holder = param->batch;
-    param->pi += 4 * sum;
+    return task;
 }
 
-int main(int argc, char **argv)
+void splitRunTask(SplitPool *pool, int worker, SplitTask *task);
+
+/* Binary splitting of [a, b) on the pool. The left half is pushed on the worker's deque for anyone to take and the worker
+   carries on with the right half. If nobody stole the left half in the meantime the worker pops it and does it too, otherwise
+   it runs other tasks until the thief is done with it. Small ranges are not worth a task and are split serially.
+*/
+void chudnovskySplitParallel(SplitPool *pool, int worker, long long a, long long b, int needP, BigInt *P, BigInt *Q, BigInt *T)
 {
-    // Getting the user input from terminal
-    int numOfIterations = atoi(argv[1]);
-    int batches = atoi(argv[2]);
+    if (b - a <= SPLIT_GRAIN || pool->workers == 1)
+    {
+        chudnovskySplitSerial(a, b, needP, P, Q, T);
+        return;
+    }
+    long long m = (a + b) / 2;
+    SplitTask *left = (SplitTask *)malloc(sizeof(SplitTask));
+    left->a = a;
+    left->b = m;
+    left->needP = 1;
+    bigInit(&left->P);
+    bigInit(&left->Q);
+    bigInit(&left->T);
+    atomic_init(&left->done, 0);
+    dequePush(&pool->deques[worker], left);
 
-    // for loop to check if the user requested more threds than there are iterations.
-    // If the number of threads is high then the terminal will print out an error message.
-    if (numOfIterations > batches)
+    BigInt P2;
+    BigInt Q2;
+    BigInt T2;
+    bigInit(&P2);
+    bigInit(&Q2);
+    bigInit(&T2);
+    chudnovskySplitParallel(pool, worker, m, b, needP, &P2, &Q2, &T2);
+
+    while (!atomic_load_explicit(&left->done, memory_order_acquire))
+    {
+        SplitTask *task = splitFindTask(pool, worker);
+        if (task != NULL)
+        {
+            splitRunTask(pool, worker, task);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    // The left half becomes the result, then the right half is merged into it.
+    *P = left->P;
+    *Q = left->Q;
+    *T = left->T;
+    free(left);
+    chudnovskyMerge(P, Q, T, &P2, &Q2, &T2, needP);
+    bigFree(&P2);
+    bigFree(&Q2);
+    bigFree(&T2);
+}
+
+void splitRunTask(SplitPool *pool, int worker, SplitTask *task)
+{
+    chudnovskySplitParallel(pool, worker, task->a, task->b, task->needP, &task->P, &task->Q, &task->T);
+    atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+// The other threads of the pool look for tasks until the whole splitting is finished.
+void *splitWorkerThread(void *w)
+{
+    SplitWorker *self = (SplitWorker *)w;
+    SplitPool *pool = self->pool;
+    while (!atomic_load(&pool->finished))
     {
-        // Creating an array to fill it with iterations from 0 - numOfIterations
-        int *array = (int *)calloc(numOfIterations, sizeof(int));
+        SplitTask *task = splitFindTask(pool, self->worker);
+        if (task != NULL)
+        {
+            splitRunTask(pool, self->worker, task);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Writes Pi = mantissa * 10^(9 * exponent) to 'file' as "3." followed by 'digits' decimals, truncated. The limbs are base 10^9
+   already, so they are printed from the most significant one down into a buffer that is flushed every time it fills up.
+*/
+void writePiDigits(FILE *file, const BigFloat *pi, long long digits)
+{
+    const BigInt *m = &pi->mantissa;
+    char buffer[1 << 16];
+    size_t used = 0;
+    long long unitLimb = -pi->exponent;
+    used += snprintf(buffer, sizeof(buffer), "%u.", (unitLimb >= 0 && unitLimb < m->size) ? m->limb[unitLimb] : 0);
 
-        for (int i = 0; i < numOfIterations; i++)
+    for (long long k = 1; digits > 0; k++)
+    {
+        long long index = unitLimb - k;
+        uint32_t limb = (index >= 0 && index < m->size) ? m->limb[index] : 0;
+        char text[BIG_DIGITS + 1];
+        snprintf(text, sizeof(text), "%09u", limb);
+        int take = digits < BIG_DIGITS ? (int)digits : BIG_DIGITS;
+        /* Flush once the chunk would leave no byte spare for the final newline. */
+        if (used + take >= sizeof(buffer))
         {
-            array[i] = i;
+            fwrite(buffer, 1, used, file);
+            used = 0;
         }
+        memcpy(buffer + used, text, take);
+        used += take;
+        digits -= take;
+    }
+    buffer[used++] = '\n';
+    fwrite(buffer, 1, used, file);
+}
+
+/* Works out 'digits' decimals of Pi = 426880 sqrt(10005) Q(0, N) / T(0, N) with N terms of the Chudnovsky series and writes
+   them to 'path'. The binary splitting runs on a work-stealing pool of 'numThreads' threads, pinned to 'cpus' if it is given.
+   Prints the time of every stage.
+*/
+int chudnovskyDigits(long long digits, int numThreads, const char *path, const int *cpus, int cpuCount)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Could not open %s for writing.\n", path);
+        return 1;
+    }
+    long long terms = (long long)(digits / CHUDNOVSKY_DIGITS_PER_TERM) + 2;
+    // A few extra limbs so that the rounding in the division and square root stays below the last digit written.
+    int limbs = (int)(digits / BIG_DIGITS) + 4;
+    bigMulThreads = numThreads;
+
+    // Binary splitting, worker 0 is this thread.
+    double startTime = secondsNow();
+    SplitPool pool;
+    pool.workers = numThreads;
+    pool.deques = (WorkDeque *)aligned_alloc(CACHE_LINE, (size_t)numThreads * sizeof(WorkDeque));
+    atomic_init(&pool.finished, 0);
+    atomic_init(&pool.steals, 0);
+    SplitWorker *workers = (SplitWorker *)malloc((size_t)numThreads * sizeof(SplitWorker));
+    pthread_t *threads = (pthread_t *)malloc((size_t)numThreads * sizeof(pthread_t));
+    for (int i = 0; i < numThreads; i++)
+    {
+        dequeInit(&pool.deques[i]);
+        workers[i].pool = &pool;
+        workers[i].worker = i;
+    }
+    for (int i = 1; i < numThreads; i++)
+    {
+        pthread_attr_t attr;
+        affinityAttr(&attr, cpus, cpuCount, i);
+        pthread_create(&threads[i], &attr, splitWorkerThread, &workers[i]);
+        pthread_attr_destroy(&attr);
+    }
+
+    BigInt P;
+    BigInt Q;
+    BigInt T;
+    bigInit(&P);
+    bigInit(&Q);
+    bigInit(&T);
+    // Worker 0 is this thread, so it is pinned to the first CPU of the plan as well.
+    if (cpuCount > 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[0], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    chudnovskySplitParallel(&pool, 0, 0, terms, 0, &P, &Q, &T);
+    atomic_store(&pool.finished, 1);
+    for (int i = 1; i < numThreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        dequeFree(&pool.deques[i]);
+    }
+    free(pool.deques);
+    free(workers);
+    free(threads);
+    bigFree(&P);
+    double splitTime = secondsNow() - startTime;
+
+    // Pi = 426880 sqrt(10005) Q / T, with sqrt(10005) = 10005 / sqrt(10005).
+    startTime = secondsNow();
+    BigFloat pi;
+    BigFloat scratch;
+    floatInit(&pi);
+    floatInit(&scratch);
+    scratch.mantissa = T;
+    floatTruncate(&scratch, limbs + 2);
+    floatReciprocal(&pi, &scratch, limbs);
+    floatFree(&scratch);
+    floatInit(&scratch);
+    scratch.mantissa = Q;
+    floatTruncate(&scratch, limbs + 2);
+    floatMul(&pi, &pi, &scratch, limbs);
+    floatFree(&scratch);
+    floatInit(&scratch);
+    floatInverseSqrt(&scratch, 10005, limbs);
+    bigMulSmall(&scratch.mantissa, 10005);
+    bigMulSmall(&scratch.mantissa, 426880);
+    floatMul(&pi, &pi, &scratch, limbs);
+    floatFree(&scratch);
+    double divideTime = secondsNow() - startTime;
+
+    startTime = secondsNow();
+    writePiDigits(file, &pi, digits);
+    fclose(file);
+    double writeTime = secondsNow() - startTime;
 
-        // This section ensure that all threads will use 'equal' amount of processes.
-        // This is done by getting the amount of threads / total amount of iterations.
-        // First we needs to find what each thread will process each section of iterations equally.
-        int batch_size = numOfIterations / batches;
-        // If there is an odd number, each one will be added from batch 0 onwards untill the amonut in remainder becomes 0.
-        int remainder = numOfIterations % batches;
+    // The first digits go to the terminal as well.
+    printf("Pi is: ");
+    writePiDigits(stdout, &pi, digits < 50 ? digits : 50);
+    printf("Digits: %lld\tTerms: %lld\tThreads: %d\tSubtrees stolen: %lld\n", digits, terms, numThreads, (long long)atomic_load(&pool.steals));
+    printf("Binary splitting: %.3f s\tDivision and square root: %.3f s\tWriting %s: %.3f s\n", splitTime, divideTime, path, writeTime);
+    floatFree(&pi);
+    return 0;
+}
+
+/* Reads a comma separated list of counts such as "1,2,4,8" or "1e6,1e7" into 'values'.
+   Returns how many were read, or -1 if one of them is not a valid count or there are more than 'max'.
+*/
+int parseList(const char *text, long long *values, int max)
+{
+    int count = 0;
+    char buffer[64];
+    while (*text != '\0')
+    {
+        const char *comma = strchr(text, ',');
+        size_t length = comma ? (size_t)(comma - text) : strlen(text);
+        if (count == max || length == 0 || length >= sizeof(buffer))
+        {
+            return -1;
+        }
+        memcpy(buffer, text, length);
+        buffer[length] = '\0';
+        values[count] = parseCount(buffer);
+        if (values[count] <= 0)
+        {
+            return -1;
+        }
+        count++;
+        text += length + (comma ? 1 : 0);
+    }
+    return count;
+}
 
-        // Creating the foundation of variable that will be manupuated to store sections of the array we created earlier on.
-        int start = 0;
-        int end = 0;
-        int index = 0;
+// Largest number of iteration sizes or thread counts a benchmark sweep takes.
+#define BENCH_MAX 32
 
-        // Struct that will store all the required variables.
-        Parameter *param = (Parameter *)calloc(batches, sizeof(Parameter));
-        // Creating threads by the amount of batches the user entered.
-        pthread_t *threads = (pthread_t *)calloc(batches, sizeof(pthread_t));
+/* Benchmark sweep: every iteration size is run with every thread count, each 'repeats' times keeping the fastest run, timed with
+   the monotonic clock around computePi. Prints one row per run as CSV or JSON with the terms per second, the speedup over the
+   first thread count in the list and the parallel efficiency (speedup per thread, relative to that first thread count).
+*/
+void scalingBenchmark(RunSettings settings, const char *kernelLabel, const long long *sizes, int sizeCount,
+                      const long long *threadCounts, int threadCount, int repeats, int json)
+{
+    int first = 1;
+    if (json)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("iterations,batches,threads,kernel,seconds,terms_per_sec,speedup,efficiency\n");
+    }
 
-        /*  
-            Lines: 90 - 111: This loop iterates through each batch. For each iteration, it calculates the 'end' for the current batch by adding the 'batch_size' to the 'start'.
-            If there is a remainder, it increments the 'end' by 1 and decrements the 'remainder' by 1.
-            It then assigns the 'array', 'end', 'start', and 'batch' number to a parameter struct and creates a thread using the leibnizFormula function and the parameter struct as input.
-            The 'start' for the next iteration is then updated to the 'end' point of the current iteration and the 'index' is incremented.
-        */
+    for (int s = 0; s < sizeCount; s++)
+    {
+        // Same rule as a normal run, there has to be more iterations than batches.
+        if (sizes[s] <= settings.batches)
+        {
+            fprintf(stderr, "Skipping %lld iterations, it is not more than the %d batches.\n", sizes[s], settings.batches);
+            continue;
+        }
+        settings.iterations = sizes[s];
+        double baseline = 0;
+        int baselineThreads = 1;
 
-        // Loop through each batch.
-        for (int i = 0; i < batches; i++)
+        for (int t = 0; t < threadCount; t++)
         {
-            // End will be populated by the batchsize + start.
-            end = start + batch_size;
-            // any remainder will increment the end value by 1 for the current parameter and decrease the remainder value by 1.
-            if (remainder > 0)
+            settings.threads = (int)threadCounts[t];
+            double best = 0;
+            // computePi never starts more threads than there are batches, so the rows report how many it really used.
+            int used = settings.threads;
+            for (int r = 0; r < repeats; r++)
+            {
+                PiResult run;
+                memset(&run, 0, sizeof(run));
+                double startTime = secondsNow();
+                computePi(&settings, &run);
+                double elapsed = secondsNow() - startTime;
+                used = run.workers;
+                free(run.workerChunks);
+                free(run.workerSteals);
+                fixedFree(&run.piFixed);
+                if (r == 0 || elapsed < best)
+                {
+                    best = elapsed;
+                }
+            }
+            if (t == 0)
             {
-                remainder--;
-                end++;
+                baseline = best;
+                baselineThreads = used;
             }
 
-            // Fill the parameter
-            param[i].array = array;
-            param[i].end = end;
-            param[i].start = start;
-            param[i].batch = index;
+            double termsPerSecond = sizes[s] / best;
+            double speedup = baseline / best;
+            double efficiency = speedup * baselineThreads / used;
+            if (json)
+            {
+                printf("%s  {\"iterations\": %lld, \"batches\": %d, \"threads\": %lld, \"kernel\": \"%s\", \"seconds\": %.6f, "
+                       "\"terms_per_sec\": %.6e, \"speedup\": %.4f, \"efficiency\": %.4f}",
+                       first ? "" : ",\n", sizes[s], settings.batches, (long long)used, kernelLabel, best, termsPerSecond, speedup, efficiency);
+            }
+            else
+            {
+                printf("%lld,%d,%lld,%s,%.6f,%.6e,%.4f,%.4f\n", sizes[s], settings.batches, (long long)used, kernelLabel, best,
+                       termsPerSecond, speedup, efficiency);
+            }
+            first = 0;
+            fflush(stdout);
+        }
+    }
+    if (json)
+    {
+        printf("\n]\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // --pi-digits and --kernel-check do not use the iterations and batches, so the options can start straight away.
+    int firstOption = (argc >= 2 && strncmp(argv[1], "--", 2) == 0) ? 1 : 3;
+    if (argc < 3 && firstOption == 3)
+    {
+        printf("Usage: ./LeibnizFormula iterations batches [--kernel=scalar|simd] [--threads=N] [--sum=naive|neumaier|pairwise] [--sum-bench]\n"
+               "       [--accel=none|euler|aitken|richardson] [--digits=N] [--tolerance=T] [--progress]\n"
+               "       [--precision=double|long|quad|fixed] [--series=leibniz|nilakantha|machin|chudnovsky] [--series-bench]\n"
+               "       [--bench=csv|json] [--bench-threads=1,2,4] [--bench-sizes=1e6,1e7] [--bench-repeat=N]\n"
+               "       [--affinity=compact|scatter|0,2,8-11]\n"
+               "   or: ./LeibnizFormula --pi-digits=N [--output=FILE] [--threads=N] [--affinity=...]\n"
+               "   or: ./LeibnizFormula --kernel-check\n");
+        return 1;
+    }
+
+    // Getting the user input from terminal
+    long long numOfIterations = 0;
+    int batches = 1;
+    if (firstOption == 3)
+    {
+        numOfIterations = parseCount(argv[1]);
+        batches = atoi(argv[2]);
+    }
+    if (numOfIterations < 0 || batches <= 0)
+    {
+        printf("Iterations must be a whole number up to 2^52 (1e12 style is fine) and batches must be positive.\n");
+        return 1;
+    }
 
-            // Call the thread.
-            pthread_create(threads + i, NULL, leibnizFormula, (void *)&param[i]);
-            index++;
-            start = end;
+    // Optional arguments after the iterations and batches.
+    const char *kernelName = "simd";
+    // The pool defaults to one thread per online CPU.
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    SumMode sumMode = SUM_NAIVE;
+    int runSumBenchmark = 0;
+    int runSeriesBenchmark = 0;
+    const Series *series = &seriesList[0];
+    // Benchmark sweep settings, -1 for no sweep, 0 for CSV and 1 for JSON.
+    int benchFormat = -1;
+    long long benchThreads[BENCH_MAX];
+    int benchThreadCount = 0;
+    long long benchSizes[BENCH_MAX];
+    int benchSizeCount = 0;
+    int benchRepeats = 3;
+    AccelMode accel = ACCEL_NONE;
+    int digits = -1;
+    double tolerance = 0;
+    int progress = 0;
+    Precision precision = PREC_DOUBLE;
+    long long piDigits = 0;
+    int runKernelCheck = 0;
+    int cpus[CPU_SETSIZE];
+    int cpuCount = 0;
+    const char *outputPath = "PiDigits.txt";
+    for (int i = firstOption; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--kernel=", 9) == 0)
+        {
+            kernelName = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            numThreads = atoi(argv[i] + 10);
+        }
+        else if (strcmp(argv[i], "--sum=naive") == 0)
+        {
+            sumMode = SUM_NAIVE;
+        }
+        else if (strcmp(argv[i], "--sum=neumaier") == 0 || strcmp(argv[i], "--sum=kahan") == 0)
+        {
+            sumMode = SUM_NEUMAIER;
+        }
+        else if (strcmp(argv[i], "--sum=pairwise") == 0)
+        {
+            sumMode = SUM_PAIRWISE;
+        }
+        else if (strcmp(argv[i], "--sum-bench") == 0)
+        {
+            runSumBenchmark = 1;
+        }
+        else if (strncmp(argv[i], "--series=", 9) == 0)
+        {
+            series = NULL;
+            for (int s = 0; s < SERIES_COUNT; s++)
+            {
+                if (strcmp(argv[i] + 9, seriesList[s].name) == 0)
+                {
+                    series = &seriesList[s];
+                }
+            }
+            if (series == NULL)
+            {
+                printf("Unknown series %s. Use leibniz, nilakantha, machin or chudnovsky\n", argv[i] + 9);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--series-bench") == 0)
+        {
+            runSeriesBenchmark = 1;
+        }
+        else if (strcmp(argv[i], "--bench") == 0 || strcmp(argv[i], "--bench=csv") == 0)
+        {
+            benchFormat = 0;
+        }
+        else if (strcmp(argv[i], "--bench=json") == 0)
+        {
+            benchFormat = 1;
+        }
+        else if (strncmp(argv[i], "--bench-threads=", 16) == 0)
+        {
+            benchThreadCount = parseList(argv[i] + 16, benchThreads, BENCH_MAX);
+            if (benchThreadCount <= 0)
+            {
+                printf("--bench-threads takes a list of thread counts such as 1,2,4,8\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--bench-sizes=", 14) == 0)
+        {
+            benchSizeCount = parseList(argv[i] + 14, benchSizes, BENCH_MAX);
+            if (benchSizeCount <= 0)
+            {
+                printf("--bench-sizes takes a list of iteration counts such as 1e7,1e8,1e9\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--bench-repeat=", 15) == 0)
+        {
+            benchRepeats = atoi(argv[i] + 15);
+            if (benchRepeats <= 0)
+            {
+                benchRepeats = 1;
+            }
+        }
+        else if (strcmp(argv[i], "--accel=none") == 0)
+        {
+            accel = ACCEL_NONE;
+        }
+        else if (strcmp(argv[i], "--accel=euler") == 0)
+        {
+            accel = ACCEL_EULER;
+        }
+        else if (strcmp(argv[i], "--accel=aitken") == 0)
+        {
+            accel = ACCEL_AITKEN;
+        }
+        else if (strcmp(argv[i], "--accel=richardson") == 0)
+        {
+            accel = ACCEL_RICHARDSON;
+        }
+        else if (strncmp(argv[i], "--digits=", 9) == 0)
+        {
+            digits = atoi(argv[i] + 9);
+        }
+        else if (strcmp(argv[i], "--precision=double") == 0)
+        {
+            precision = PREC_DOUBLE;
+        }
+        else if (strcmp(argv[i], "--precision=long") == 0)
+        {
+            precision = PREC_LONG_DOUBLE;
+        }
+        else if (strcmp(argv[i], "--precision=quad") == 0)
+        {
+            precision = PREC_QUAD;
+        }
+        else if (strcmp(argv[i], "--precision=fixed") == 0)
+        {
+            precision = PREC_FIXED;
+        }
+        else if (strncmp(argv[i], "--pi-digits=", 12) == 0)
+        {
+            piDigits = parseCount(argv[i] + 12);
+            if (piDigits <= 0 || piDigits > PI_DIGITS_MAX)
+            {
+                printf("--pi-digits takes a number of digits from 1 to %lld such as 1e6.\n", PI_DIGITS_MAX);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--kernel-check") == 0)
+        {
+            runKernelCheck = 1;
         }
+        else if (strncmp(argv[i], "--affinity=", 11) == 0)
+        {
+            cpuCount = affinityPlan(argv[i] + 11, cpus, CPU_SETSIZE);
+            if (cpuCount <= 0)
+            {
+                printf("--affinity takes compact, scatter or a list of CPUs this process can use such as 0,2,8-11\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+        {
+            outputPath = argv[i] + 9;
+        }
+        else if (strcmp(argv[i], "--progress") == 0)
+        {
+            progress = 1;
+        }
+        else if (strncmp(argv[i], "--tolerance=", 12) == 0)
+        {
+            tolerance = atof(argv[i] + 12);
+            if (tolerance <= 0)
+            {
+                printf("The tolerance must be a positive number such as 1e-8.\n");
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    const char *kernelLabel = NULL;
+    SeriesKernel kernel = selectKernel(series, kernelName, &kernelLabel);
+    if (kernel == NULL)
+    {
+        printf("Unknown kernel %s. Use --kernel=scalar or --kernel=simd\n", kernelName);
+        return 1;
+    }
+    if (numThreads <= 0)
+    {
+        numThreads = 1;
+    }
+    if (piDigits > 0)
+    {
+        return chudnovskyDigits(piDigits, numThreads, outputPath, cpuCount > 0 ? cpus : NULL, cpuCount);
+    }
+    if (runKernelCheck)
+    {
+        return kernelCheck() != 0;
+    }
+    if (firstOption == 1)
+    {
+        printf("The iterations and batches can only be left out with --pi-digits or --kernel-check.\n");
+        return 1;
+    }
+    if (series != &seriesList[0] && (accel != ACCEL_NONE || precision != PREC_DOUBLE))
+    {
+        printf("--accel and --precision only work with the Leibniz series.\n");
+        return 1;
+    }
+    if (precision != PREC_DOUBLE && (accel == ACCEL_AITKEN || accel == ACCEL_RICHARDSON))
+    {
+        printf("Only --accel=euler is available with extended precision.\n");
+        return 1;
+    }
+    if (precision != PREC_DOUBLE && (runSumBenchmark || runSeriesBenchmark))
+    {
+        printf("--sum-bench compares the double summation modes, leave out --precision.\n");
+        return 1;
+    }
 
-        for (int i = 0; i < batches; i++)
+    // Without --digits, print 5 decimals (or what the number type can hold) or as many as the tolerance asks for.
+    if (digits < 0)
+    {
+        const int defaultDigits[] = {5, 18, 32, 50};
+        digits = defaultDigits[precision];
+        if (tolerance > 0 && ceil(-log10(tolerance)) > digits)
         {
-            pthread_join(threads[i], NULL);
+            digits = (int)ceil(-log10(tolerance));
         }
+    }
+
+    // for loop to check if the user requested more threds than there are iterations.
+    // If the number of threads is high then the terminal will print out an error message.
+    if (numOfIterations > batches)
+    {
+        RunSettings settings;
+        settings.iterations = numOfIterations;
+        settings.batches = batches;
+        settings.threads = numThreads;
+        settings.series = series;
+        settings.kernel = kernel;
+        settings.sumMode = sumMode;
+        settings.accel = accel;
+        settings.tolerance = tolerance;
+        settings.progress = progress;
+        settings.precision = precision;
+        settings.fixedDigits = digits;
+        settings.cpus = cpuCount > 0 ? cpus : NULL;
+        settings.cpuCount = cpuCount;
 
-        double truestPi = 0;
-        for (int i = 0; i < batches; i++)
+        if (runSumBenchmark)
+        {
+            sumBenchmark(settings);
+            return 0;
+        }
+        if (runSeriesBenchmark)
+        {
+            seriesBenchmark(settings, kernelName);
+            return 0;
+        }
+        if (benchFormat >= 0)
         {
-            truestPi += param[i].pi;
+            // By default sweep the thread counts 1, 2, 4, ... up to the CPU count, and N/100, N/10 and N iterations.
+            if (benchThreadCount == 0)
+            {
+                for (long long t = 1; t < numThreads && benchThreadCount < BENCH_MAX - 1; t *= 2)
+                {
+                    benchThreads[benchThreadCount++] = t;
+                }
+                benchThreads[benchThreadCount++] = numThreads;
+            }
+            if (benchSizeCount == 0)
+            {
+                benchSizes[benchSizeCount++] = numOfIterations / 100;
+                benchSizes[benchSizeCount++] = numOfIterations / 10;
+                benchSizes[benchSizeCount++] = numOfIterations;
+            }
+            scalingBenchmark(settings, kernelLabel, benchSizes, benchSizeCount, benchThreads, benchThreadCount, benchRepeats, benchFormat);
+            return 0;
         }
 
-        //Prints the closest Pi number as specified by the iterations from user.
-        printf("Pi is: %.5f\n", truestPi);
+        PiResult result;
+        memset(&result, 0, sizeof(result));
+        double truestPi = computePi(&settings, &result);
+        long long termsUsed = result.termsUsed;
 
-        // Freeing allocated memory.
-        free(param);
-        free(threads);
-        free(array);
+        //Prints the closest Pi number as specified by the iterations from user.
+        if (precision == PREC_LONG_DOUBLE)
+        {
+            printf("Pi is: %.*Lf\n", digits, result.piLong);
+        }
+        else if (precision == PREC_QUAD || precision == PREC_FIXED)
+        {
+            char *text = (char *)malloc(digits + 32);
+            if (precision == PREC_QUAD)
+            {
+                quadToDecimal(result.piQuad, text, digits);
+            }
+            else
+            {
+                fixedToDecimal(&result.piFixed, text, digits);
+                fixedFree(&result.piFixed);
+            }
+            printf("Pi is: %s\n", text);
+            free(text);
+        }
+        else
+        {
+            printf("Pi is: %.*f\n", digits, truestPi);
+        }
+        if (tolerance > 0)
+        {
+            // The bound is for the plain partial sum, any acceleration on top of it only makes the error smaller.
+            double bound = series->errorBound(termsUsed);
+            printf("Terms used: %lld\tError bound: %.3e%s\n", termsUsed, bound,
+                   bound < tolerance ? "" : "\t(tolerance not reached, raise the iterations)");
+        }
+        printf("Series: %s\tKernel: %s\tThreads: %d\n", series->name, kernelLabel, numThreads < batches ? numThreads : batches);
+        // Batches run by every pool thread, with the stolen ones in brackets. Uneven counts mean some cores were slower.
+        printf("Batches per thread:");
+        for (int i = 0; i < result.workers; i++)
+        {
+            printf(" %d(%d)", result.workerChunks[i], result.workerSteals[i]);
+        }
+        printf("\n");
+        free(result.workerChunks);
+        free(result.workerSteals);
     }
     else
     {
-        printf("Can't have more threads that the amount of iterations. Please try again.\nIterations selected %d\tThreads:%d\n", numOfIterations, batches);
+        printf("Can't have more threads that the amount of iterations. Please try again.\nIterations selected %lld\tThreads:%d\n", numOfIterations, batches);
     }
     return 0;
-}
+}
\ No newline at end of file
@@ -1,164 +1,1948 @@
 /*LinearRegression:
 This program will run by initiating which files the user wants the program to read(Example: ./LinearRegression textfile1.txt textfile2.txt).
 The program will do the following:
-    - Read each file individually whilst counting how many characters there are in the file and allocating/reallocating space to a pointer called temparrayinstring.
-    - In the same cycle the program will aquire each character and allocate it to temparrayinstring.
-    - StringToken will be used to remove unwanted characters such as ',' or empty values this is filtered and allocated to another pointer called ptr.
-    - An arrayofint is created with the size 4 times larger than temparrayinstring to hold integers.
-    - The contents on ptr will be converted to int and allocated to arrayofint.
-    - Due to the array being 1 dimension, modules was used to aquire X and Y.
+    - Read each file in blocks of READ_BLOCK bytes with fread, so the file is never read one character at a time.
+    - Every complete line in the block is parsed straight away by a hand-written number parser (ParseNumber) into a block of X and Y columns.
+      Numbers can have a fraction and an exponent (3.25, -1.5e-3) and are rounded correctly, whatever the machine's locale is.
+      A line cut in half at the end of a block is moved to the front of the buffer and finished with the next block.
+    - The points are kept as separate X and Y columns, and every time the block is full it is summed in one pass (with AVX2 when
+      the CPU has it) and pushed into an Accumulator, which keeps the count, the means of X and Y and
+      their co-moments, the numerically stable form of the sums the regression needs. No text or points are kept after that, so memory use stays the same however much data there is,
+      and "-" as a file name reads the data from a pipe.
+    - Normally the files are not even read: they are mapped into memory (MapDataset) and parsed in place. A file that can't be
+      mapped, or every file when --no-mmap is given, goes through the buffered reader above.
+    - The files are parsed by --threads=N threads (one for each CPU by default). A big file is cut into byte ranges, each line
+      belongs to the range it starts in, and every range is parsed into its own Accumulator. The partial sums are merged at the end.
     - After getting X and Y, then LR was aquired.
+    - With --features=K every line holds K values of X and then Y, and a multiple regression y = a + b1*x1 + ... + bK*xK is fitted.
+      The centred X^T X and X^T y are built a tile of lines at a time (MatrixPushBlock) and solved with a Cholesky factorisation.
+    - With --cache=FILE the statistics of every dataset are saved in FILE with its size, time and a hash of its contents, and the
+      next run with the same cache only parses the datasets that changed. A dataset that only had lines appended to it since then
+      is not parsed again either, only the new lines at its end are parsed and added to the saved statistics.
+    - With --predict=FILE (or --predict=- for standard input) the values of X in FILE are scored in blocks instead of asking for one,
+      and the predicted Y of every line is written to standard output.
 
  After running the program enter value of Y.
 
     To run code:
-        gcc LinearRegression.c -o LinearRegression;
+        gcc LinearRegression.c -o LinearRegression -pthread -lm;
         ./LinearRegression datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; 
-        rm LinearRegression;
+        ./LinearRegression --cache=LinearRegression.cache datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; 
+        ./LinearRegression --threads=4 datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; 
+        ./LinearRegression --no-mmap datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; 
+        cat datasetLR*.txt | ./LinearRegression -; 
+        seq 1 100 | ./LinearRegression --predict=- datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; 
+        rm LinearRegression LinearRegression.cache;
 
 */
 
+// For strtod_l.
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <locale.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Number of bytes read from a dataset at a time.
+#define READ_BLOCK (1 << 20)
+// Number of bytes of a dataset mapped at a time, so a huge file never has more than this much of it mapped.
+#define MAP_WINDOW (256LL << 20)
+
+// Smallest range of a file given to one parsing task, a file smaller than this is parsed by a single thread.
+#define RANGE_MIN (1LL << 20)
+
+// Number of points parsed into a PointBlock before the block is pushed into an accumulator.
+#define POINT_BLOCK 4096
+
+// Largest number of feature columns for a multiple regression (--features=K).
+#define MAX_FEATURES 32
+// Number of rows of a block that are centred and transposed at a time for the cross product update, so a tile of every column
+// (at most 33 columns of 64 doubles) stays in the L1 cache while all the column pairs are multiplied.
+#define TILE_ROWS 64
+
+/*
+    Streaming accumulator for the regression. Instead of raw sums of X, X^2, XY and so on, which lose every digit that matters
+    when they are subtracted from each other for large values or many points, it keeps the means of X and Y and the sums of squared
+    deviations from those means (co-moments), updated with Welford's method. Points can be pushed one at a time or a block at a time
+    as they arrive, from a file, a pipe or a socket, without keeping them and without a second pass.
+    Two accumulators filled from different parts of the data are merged with the pairwise formula of Chan, Golub and LeVeque.
+*/
+typedef struct
+{
+    long long Inputs;
+    double MeanX;
+    double MeanY;
+    // Sum of (X - MeanX)^2, sum of (Y - MeanY)^2 and sum of (X - MeanX)(Y - MeanY).
+    double M2X;
+    double M2Y;
+    double CXY;
+} Accumulator;
+
+/*
+    Accumulator for a multiple regression y = a + b1*x1 + ... + bK*xK, the same idea as Accumulator for K columns of X. It keeps
+    the mean of every column (the features, then Y as the last column) and the centred cross products of every pair of columns,
+    the centred X^T X with X^T y in its last column. Only the upper triangle of 'Co' is used, stored Columns by Columns.
+*/
+typedef struct
+{
+    long long Inputs;
+    int Columns;
+    double Mean[MAX_FEATURES + 1];
+    double Co[(MAX_FEATURES + 1) * (MAX_FEATURES + 1)];
+} MatrixAccumulator;
+
+/*
+    Everything pushed from the datasets. With one feature every line is an X,Y pair and goes into 'Simple', with --features=K
+    every line is K features and then Y and goes into 'Multiple'.
+*/
+typedef struct
+{
+    int Features;
+    Accumulator Simple;
+    MatrixAccumulator Multiple;
+} Statistics;
+
+/*
+    Points parsed from a dataset waiting to be pushed into an accumulator, X[i] and Y[i] are one line. With more than one feature
+    the lines go into 'Rows' instead, 'Columns' values per line.
+*/
+typedef struct
+{
+    double X[POINT_BLOCK];
+    double Y[POINT_BLOCK];
+    double *Rows;
+    int Columns;
+    int Count;
+} PointBlock;
+
+/*
+    This function is used to calculate the values of 'A' and 'B', which are used for linear regression. The variables 'A' and 'B' are pased in as pointers, as
+    are the means 'MeanX' and 'MeanY', the sum of squared deviations of X 'M2X' and the co-moment of X and Y 'CXY'.
+    The slope is B = CXY / M2X and the line goes through the point of means, so A = MeanY - B * MeanX.
+    The values 'A' and 'B' are then stored in the memory location pointed to by the pointers 'A' and 'B', respectively.
+*/
+void FindingLR(double *A, double *B, double *MeanX, double *MeanY, double *M2X, double *CXY)
+{
+    *B = *CXY / *M2X;
+    *A = *MeanY - (*B * *MeanX);
+}
+
+void AccumulatorInit(Accumulator *acc)
+{
+    acc->Inputs = 0;
+    acc->MeanX = 0;
+    acc->MeanY = 0;
+    acc->M2X = 0;
+    acc->M2Y = 0;
+    acc->CXY = 0;
+}
+
+// Adds one point. The co-moments are updated with the deviation from the mean before and after the point moved it.
+void AccumulatorPush(Accumulator *acc, double x, double y)
+{
+    acc->Inputs++;
+    double dx = x - acc->MeanX;
+    double dy = y - acc->MeanY;
+    acc->MeanX += dx / acc->Inputs;
+    acc->MeanY += dy / acc->Inputs;
+    acc->M2X += dx * (x - acc->MeanX);
+    acc->M2Y += dy * (y - acc->MeanY);
+    acc->CXY += dx * (y - acc->MeanY);
+}
+
+// Adds everything pushed into 'from' to 'into', as if the points had all been pushed into 'into'.
+void AccumulatorMerge(Accumulator *into, const Accumulator *from)
+{
+    if (from->Inputs == 0)
+    {
+        return;
+    }
+    if (into->Inputs == 0)
+    {
+        *into = *from;
+        return;
+    }
+    double na = (double)into->Inputs;
+    double nb = (double)from->Inputs;
+    double n = na + nb;
+    double dx = from->MeanX - into->MeanX;
+    double dy = from->MeanY - into->MeanY;
+    double weight = na * nb / n;
+    into->M2X += from->M2X + dx * dx * weight;
+    into->M2Y += from->M2Y + dy * dy * weight;
+    into->CXY += from->CXY + dx * dy * weight;
+    into->MeanX += dx * nb / n;
+    into->MeanY += dy * nb / n;
+    into->Inputs += from->Inputs;
+}
+
+/*
+    The five sums of a block of points in one pass: X, Y, X*X, Y*Y and X*Y, all taken after subtracting 'shiftX' from X and
+    'shiftY' from Y. With a shift close to the mean the sums stay small and AccumulatorPushBlock can turn them into co-moments
+    without the cancellation the raw sums have. Two points are summed at a time into separate sums so the additions overlap.
+*/
+void BlockSums(const double *X, const double *Y, long long count, double shiftX, double shiftY, double sums[5])
+{
+    double x0 = 0, y0 = 0, xx0 = 0, yy0 = 0, xy0 = 0;
+    double x1 = 0, y1 = 0, xx1 = 0, yy1 = 0, xy1 = 0;
+    long long i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        double dx0 = X[i] - shiftX;
+        double dy0 = Y[i] - shiftY;
+        double dx1 = X[i + 1] - shiftX;
+        double dy1 = Y[i + 1] - shiftY;
+        x0 += dx0;
+        y0 += dy0;
+        xx0 += dx0 * dx0;
+        yy0 += dy0 * dy0;
+        xy0 += dx0 * dy0;
+        x1 += dx1;
+        y1 += dy1;
+        xx1 += dx1 * dx1;
+        yy1 += dy1 * dy1;
+        xy1 += dx1 * dy1;
+    }
+    if (i < count)
+    {
+        double dx = X[i] - shiftX;
+        double dy = Y[i] - shiftY;
+        x0 += dx;
+        y0 += dy;
+        xx0 += dx * dx;
+        yy0 += dy * dy;
+        xy0 += dx * dy;
+    }
+    sums[0] = x0 + x1;
+    sums[1] = y0 + y1;
+    sums[2] = xx0 + xx1;
+    sums[3] = yy0 + yy1;
+    sums[4] = xy0 + xy1;
+}
+
+// BlockSums eight points at a time with AVX2, in two sets of five vector sums so no addition waits on the one before it.
+__attribute__((target("avx2"))) void BlockSumsAVX2(const double *X, const double *Y, long long count, double shiftX, double shiftY, double sums[5])
+{
+    const __m256d kx = _mm256_set1_pd(shiftX);
+    const __m256d ky = _mm256_set1_pd(shiftY);
+    __m256d x0 = _mm256_setzero_pd(), y0 = x0, xx0 = x0, yy0 = x0, xy0 = x0;
+    __m256d x1 = x0, y1 = x0, xx1 = x0, yy1 = x0, xy1 = x0;
+    long long i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256d dx0 = _mm256_sub_pd(_mm256_loadu_pd(X + i), kx);
+        __m256d dy0 = _mm256_sub_pd(_mm256_loadu_pd(Y + i), ky);
+        __m256d dx1 = _mm256_sub_pd(_mm256_loadu_pd(X + i + 4), kx);
+        __m256d dy1 = _mm256_sub_pd(_mm256_loadu_pd(Y + i + 4), ky);
+        x0 = _mm256_add_pd(x0, dx0);
+        y0 = _mm256_add_pd(y0, dy0);
+        xx0 = _mm256_add_pd(xx0, _mm256_mul_pd(dx0, dx0));
+        yy0 = _mm256_add_pd(yy0, _mm256_mul_pd(dy0, dy0));
+        xy0 = _mm256_add_pd(xy0, _mm256_mul_pd(dx0, dy0));
+        x1 = _mm256_add_pd(x1, dx1);
+        y1 = _mm256_add_pd(y1, dy1);
+        xx1 = _mm256_add_pd(xx1, _mm256_mul_pd(dx1, dx1));
+        yy1 = _mm256_add_pd(yy1, _mm256_mul_pd(dy1, dy1));
+        xy1 = _mm256_add_pd(xy1, _mm256_mul_pd(dx1, dy1));
+    }
+    __m256d total[5] = {_mm256_add_pd(x0, x1), _mm256_add_pd(y0, y1), _mm256_add_pd(xx0, xx1), _mm256_add_pd(yy0, yy1), _mm256_add_pd(xy0, xy1)};
+    for (int s = 0; s < 5; s++)
+    {
+        double lanes[4];
+        _mm256_storeu_pd(lanes, total[s]);
+        sums[s] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+    _mm256_zeroupper();
+
+    // Whatever did not fill two full vectors is finished by the scalar kernel.
+    double rest[5];
+    BlockSums(X + i, Y + i, count - i, shiftX, shiftY, rest);
+    for (int s = 0; s < 5; s++)
+    {
+        sums[s] += rest[s];
+    }
+}
+
+/*
+    Adds 'count' points at once with a single pass over the X and Y columns of the block (BlockSums, or BlockSumsAVX2 when the CPU
+    has it). The sums are taken around the running means, or the block's first point for the first block, and turned into the
+    block's means and co-moments: with sums S of the shifted values, M2X = Sxx - Sx*Sx/n and so on. The block is merged into the
+    running accumulator once.
+*/
+void AccumulatorPushBlock(Accumulator *acc, const double *X, const double *Y, long long count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    double shiftX = (acc->Inputs > 0) ? acc->MeanX : X[0];
+    double shiftY = (acc->Inputs > 0) ? acc->MeanY : Y[0];
+    double sums[5];
+    if (__builtin_cpu_supports("avx2"))
+    {
+        BlockSumsAVX2(X, Y, count, shiftX, shiftY, sums);
+    }
+    else
+    {
+        BlockSums(X, Y, count, shiftX, shiftY, sums);
+    }
+    Accumulator block;
+    block.Inputs = count;
+    block.MeanX = shiftX + sums[0] / count;
+    block.MeanY = shiftY + sums[1] / count;
+    block.M2X = sums[2] - sums[0] * sums[0] / count;
+    block.M2Y = sums[3] - sums[1] * sums[1] / count;
+    block.CXY = sums[4] - sums[0] * sums[1] / count;
+    // Rounding can leave a tiny negative square sum for a block where every value is the same.
+    block.M2X = (block.M2X < 0) ? 0 : block.M2X;
+    block.M2Y = (block.M2Y < 0) ? 0 : block.M2Y;
+    AccumulatorMerge(acc, &block);
+}
+
+/*
+    Works out y = bx + a from the points pushed so far with FindingLR. Returns 0, or 1 if there are fewer than two points or
+    every X is the same, in which case there is no line to fit.
+*/
+int AccumulatorFit(const Accumulator *acc, double *A, double *B)
+{
+    Accumulator copy = *acc;
+    if (copy.Inputs < 2 || copy.M2X == 0)
+    {
+        return 1;
+    }
+    FindingLR(A, B, &copy.MeanX, &copy.MeanY, &copy.M2X, &copy.CXY);
+    return 0;
+}
+
+void MatrixInit(MatrixAccumulator *m, int features)
+{
+    memset(m, 0, sizeof(*m));
+    m->Columns = features + 1;
+}
+
+// Adds everything pushed into 'from' to 'into', the pairwise merge of AccumulatorMerge applied to every pair of columns.
+void MatrixMerge(MatrixAccumulator *into, const MatrixAccumulator *from)
+{
+    if (from->Inputs == 0)
+    {
+        return;
+    }
+    if (into->Inputs == 0)
+    {
+        *into = *from;
+        return;
+    }
+    int c = into->Columns;
+    double na = (double)into->Inputs;
+    double nb = (double)from->Inputs;
+    double n = na + nb;
+    double weight = na * nb / n;
+    double d[MAX_FEATURES + 1];
+    for (int i = 0; i < c; i++)
+    {
+        d[i] = from->Mean[i] - into->Mean[i];
+    }
+    for (int i = 0; i < c; i++)
+    {
+        for (int j = i; j < c; j++)
+        {
+            into->Co[i * c + j] += from->Co[i * c + j] + d[i] * d[j] * weight;
+        }
+        into->Mean[i] += d[i] * nb / n;
+    }
+    into->Inputs += from->Inputs;
+}
+
+// Dot product of two columns of a tile, 'n' is a multiple of 4. Four running sums let the additions overlap.
+double DotProduct(const double *a, const double *b, int n)
+{
+    double s0 = 0;
+    double s1 = 0;
+    double s2 = 0;
+    double s3 = 0;
+    for (int i = 0; i < n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+// DotProduct four rows at a time with AVX2, with two vector sums so consecutive additions do not wait on each other.
+__attribute__((target("avx2"))) double DotProductAVX2(const double *a, const double *b, int n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    if (i < n)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    _mm256_zeroupper();
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+/*
+    Adds 'count' lines of 'rows' (Columns values each) at once. As in AccumulatorPushBlock the block's means are found first.
+    The block is then centred TILE_ROWS lines at a time into a tile stored column by column, and every pair of columns of the tile
+    is multiplied into the cross products, a rank TILE_ROWS update of the whole matrix done with one dot product per entry while
+    the tile is in cache. The block is merged into the running accumulator once.
+*/
+void MatrixPushBlock(MatrixAccumulator *m, const double *rows, long long count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    int c = m->Columns;
+    double (*dot)(const double *, const double *, int) = __builtin_cpu_supports("avx2") ? DotProductAVX2 : DotProduct;
+    MatrixAccumulator block;
+    MatrixInit(&block, c - 1);
+    block.Inputs = count;
+    for (long long r = 0; r < count; r++)
+    {
+        for (int i = 0; i < c; i++)
+        {
+            block.Mean[i] += rows[r * c + i];
+        }
+    }
+    for (int i = 0; i < c; i++)
+    {
+        block.Mean[i] /= count;
+    }
+
+    double tile[(MAX_FEATURES + 1) * TILE_ROWS];
+    for (long long first = 0; first < count; first += TILE_ROWS)
+    {
+        int n = (count - first < TILE_ROWS) ? (int)(count - first) : TILE_ROWS;
+        // The last tile is padded with zeros to a whole number of vectors, which adds nothing to the products.
+        int padded = (n + 3) & ~3;
+        for (int i = 0; i < c; i++)
+        {
+            double *column = tile + i * TILE_ROWS;
+            for (int r = 0; r < n; r++)
+            {
+                column[r] = rows[(first + r) * c + i] - block.Mean[i];
+            }
+            for (int r = n; r < padded; r++)
+            {
+                column[r] = 0;
+            }
+        }
+        for (int i = 0; i < c; i++)
+        {
+            for (int j = i; j < c; j++)
+            {
+                block.Co[i * c + j] += dot(tile + i * TILE_ROWS, tile + j * TILE_ROWS, padded);
+            }
+        }
+    }
+    MatrixMerge(m, &block);
+}
+
+/*
+    Works out y = a + b1*x1 + ... + bK*xK from the lines pushed so far. The normal equations (centred X^T X) b = (centred X^T y)
+    are solved with a Cholesky factorisation L L^T of the symmetric matrix, then 'a' is found from the means like A in FindingLR.
+    The K coefficients go into 'B'. Returns 0, or 1 if there are not more lines than features or a feature is constant or a mix
+    of the others, in which case there is no single fit.
+*/
+int MatrixFit(const MatrixAccumulator *m, double *A, double *B)
+{
+    int c = m->Columns;
+    int k = c - 1;
+    if (m->Inputs <= k)
+    {
+        return 1;
+    }
+    double L[MAX_FEATURES * MAX_FEATURES];
+    for (int i = 0; i < k; i++)
+    {
+        for (int j = 0; j <= i; j++)
+        {
+            double sum = m->Co[j * c + i];
+            for (int p = 0; p < j; p++)
+            {
+                sum -= L[i * k + p] * L[j * k + p];
+            }
+            if (i != j)
+            {
+                L[i * k + j] = sum / L[j * k + j];
+            }
+            else if (sum <= m->Co[i * c + i] * 1e-12)
+            {
+                // (Almost) none of the column's spread is left once the columns before it are taken out.
+                return 1;
+            }
+            else
+            {
+                L[i * k + i] = sqrt(sum);
+            }
+        }
+    }
+    // Solve L z = X^T y, then L^T b = z.
+    double z[MAX_FEATURES];
+    for (int i = 0; i < k; i++)
+    {
+        double sum = m->Co[i * c + k];
+        for (int p = 0; p < i; p++)
+        {
+            sum -= L[i * k + p] * z[p];
+        }
+        z[i] = sum / L[i * k + i];
+    }
+    *A = m->Mean[k];
+    for (int i = k - 1; i >= 0; i--)
+    {
+        double sum = z[i];
+        for (int p = i + 1; p < k; p++)
+        {
+            sum -= L[p * k + i] * B[p];
+        }
+        B[i] = sum / L[i * k + i];
+    }
+    for (int i = 0; i < k; i++)
+    {
+        *A -= B[i] * m->Mean[i];
+    }
+    return 0;
+}
+
+void StatisticsInit(Statistics *stats, int features)
+{
+    stats->Features = features;
+    AccumulatorInit(&stats->Simple);
+    MatrixInit(&stats->Multiple, features);
+}
+
+void StatisticsMerge(Statistics *into, const Statistics *from)
+{
+    AccumulatorMerge(&into->Simple, &from->Simple);
+    MatrixMerge(&into->Multiple, &from->Multiple);
+}
+
+PointBlock *PointBlockCreate(int features)
+{
+    PointBlock *block = malloc(sizeof(PointBlock));
+    block->Columns = features + 1;
+    block->Rows = (features > 1) ? malloc((size_t)POINT_BLOCK * block->Columns * sizeof(double)) : NULL;
+    block->Count = 0;
+    return block;
+}
+
+void PointBlockFree(PointBlock *block)
+{
+    free(block->Rows);
+    free(block);
+}
+
+// Pushes the lines waiting in the block into the accumulator that matches its shape and empties it.
+void PointBlockFlush(PointBlock *block, Statistics *stats)
+{
+    if (block->Rows != NULL)
+    {
+        MatrixPushBlock(&stats->Multiple, block->Rows, block->Count);
+    }
+    else
+    {
+        AccumulatorPushBlock(&stats->Simple, block->X, block->Y, block->Count);
+    }
+    block->Count = 0;
+}
+
+// Prints the error for a line that does not have the values the block expects.
+void ReportBadLine(long long line, const char *path, int columns)
+{
+    if (columns == 2)
+    {
+        printf("Line %lld of %s is not an X,Y pair.\n", line, path);
+    }
+    else
+    {
+        printf("Line %lld of %s is not %d comma separated numbers.\n", line, path, columns);
+    }
+}
+
+// "C" locale for strtod_l, so a comma locale on the machine never changes how "3.25" is read. Made once by the first thread to need it.
+static locale_t NumberLocale;
+static pthread_once_t NumberLocaleOnce = PTHREAD_ONCE_INIT;
+
+void MakeNumberLocale(void)
+{
+    NumberLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+/*
+    Parses a number such as 42, -7, 3.25 or -1.5e-3 starting at 's', without reading past 'end'. Spaces around the number are
+    skipped. The digits are collected into a 64-bit integer with the power of ten they have to be scaled by. When that integer
+    fits in the 53 bits of a double and the power is at most 22, both are exact doubles and one multiplication or division gives
+    the correctly rounded result, which covers nearly every number in a real dataset with no strtod call and no locale lookup.
+    Anything else (more than 17 or so significant digits, or a large exponent) is handed to strtod_l in the "C" locale, which
+    rounds it correctly. Returns the character after the number, or NULL if there is no number at 's'.
+*/
+const char *ParseNumber(const char *s, const char *end, double *value)
+{
+    static const double PowersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    while (s < end && (*s == ' ' || *s == '\t'))
+    {
+        s++;
+    }
+    const char *start = s;
+    int negative = 0;
+    if (s < end && (*s == '-' || *s == '+'))
+    {
+        negative = (*s == '-');
+        s++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    // Set when a digit did not fit in the mantissa, the fast path would then round twice.
+    int dropped = 0;
+    // Power of ten the mantissa has to be multiplied by, negative for digits after the point.
+    int scale = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, digits++)
+    {
+        if (mantissa < 100000000000000000ULL)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+        }
+        else
+        {
+            dropped |= (*s != '0');
+            scale++;
+        }
+    }
+    if (s < end && *s == '.')
+    {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, digits++)
+        {
+            if (mantissa < 100000000000000000ULL)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+                scale--;
+            }
+            else
+            {
+                dropped |= (*s != '0');
+            }
+        }
+    }
+    if (digits == 0)
+    {
+        return NULL;
+    }
+    // An exponent only counts when it has digits, "2e" is the number 2 followed by an 'e'.
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char *p = s + 1;
+        int exponentNegative = 0;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exponentNegative = (*p == '-');
+            p++;
+        }
+        if (p < end && *p >= '0' && *p <= '9')
+        {
+            int exponent = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; p++)
+            {
+                // Far past the range of a double already, stop before the int overflows.
+                if (exponent < 100000)
+                {
+                    exponent = exponent * 10 + (*p - '0');
+                }
+            }
+            scale += exponentNegative ? -exponent : exponent;
+            s = p;
+        }
+    }
+
+    double result;
+    if (!dropped && mantissa <= (1ULL << 53) && scale >= -22 && scale <= 22)
+    {
+        result = (double)mantissa;
+        result = (scale < 0) ? result / PowersOf10[-scale] : result * PowersOf10[scale];
+        result = negative ? -result : result;
+    }
+    else
+    {
+        // The number ends at a character that is not part of it (at worst the '\n' the caller guarantees), so strtod_l stops
+        // at the same place.
+        pthread_once(&NumberLocaleOnce, MakeNumberLocale);
+        result = strtod_l(start, NULL, NumberLocale);
+    }
+    *value = result;
+
+    while (s < end && (*s == ' ' || *s == '\t'))
+    {
+        s++;
+    }
+    return s;
+}
+
+/*
+    Parses the line "X,Y" starting at 's' into 'x' and 'y'. The caller makes sure there is a '\n' before 'end', so the line is read
+    in a single scan without looking for its end first. Returns the start of the next line, or NULL if the line is not an X,Y pair.
+    An empty line returns with 'empty' set and no values. The '\r' of Windows line endings is skipped.
+*/
+const char *ParseLine(const char *s, const char *end, double *x, double *y, int *empty)
+{
+    const char *p = s;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+    {
+        p++;
+    }
+    *empty = (*p == '\n');
+    if (*empty)
+    {
+        return p + 1;
+    }
+    p = ParseNumber(p, end, x);
+    if (p == NULL || *p != ',')
+    {
+        return NULL;
+    }
+    p = ParseNumber(p + 1, end, y);
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    if (*p == '\r')
+    {
+        p++;
+    }
+    return (*p == '\n') ? p + 1 : NULL;
+}
+
+// ParseLine for a line of 'count' comma separated numbers, stored into 'values'.
+const char *ParseRow(const char *s, const char *end, double *values, int count, int *empty)
+{
+    const char *p = s;
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+    {
+        p++;
+    }
+    *empty = (*p == '\n');
+    if (*empty)
+    {
+        return p + 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            if (*p != ',')
+            {
+                return NULL;
+            }
+            p++;
+        }
+        p = ParseNumber(p, end, &values[i]);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+    }
+    if (*p == '\r')
+    {
+        p++;
+    }
+    return (*p == '\n') ? p + 1 : NULL;
+}
+
+/*
+    Parses every line of [start, stop) into 'block', 'stop' must be just after a '\n'. Each time the block fills up it is pushed
+    into the statistics and emptied. 'line' counts the lines for error messages. Returns 0, or 1 on a line that is not an X,Y pair
+    (or not the block's number of values).
+*/
+int ParseLines(const char *start, const char *stop, PointBlock *block, Statistics *stats, long long *line)
+{
+    int empty = 0;
+    while (start < stop)
+    {
+        (*line)++;
+        if (block->Rows != NULL)
+        {
+            start = ParseRow(start, stop, &block->Rows[(size_t)block->Count * block->Columns], block->Columns, &empty);
+        }
+        else
+        {
+            start = ParseLine(start, stop, &block->X[block->Count], &block->Y[block->Count], &empty);
+        }
+        if (start == NULL)
+        {
+            return 1;
+        }
+        if (!empty && ++block->Count == POINT_BLOCK)
+        {
+            PointBlockFlush(block, stats);
+        }
+    }
+    return 0;
+}
+
+/*
+    Counts the '\n' characters in the first 'upTo' bytes of a file. Only used to turn the position of a bad line into a line
+    number for the error message when the file was parsed in ranges.
+*/
+long long CountLines(int fd, long long upTo)
+{
+    char buffer[1 << 16];
+    long long lines = 0;
+    long long done = 0;
+    while (done < upTo)
+    {
+        long long want = (upTo - done < (long long)sizeof(buffer)) ? upTo - done : (long long)sizeof(buffer);
+        ssize_t got = pread(fd, buffer, want, done);
+        if (got <= 0)
+        {
+            break;
+        }
+        for (const char *p = buffer; (p = memchr(p, '\n', buffer + got - p)) != NULL; p++)
+        {
+            lines++;
+        }
+        done += got;
+    }
+    return lines;
+}
+
+/*
+    Reads the lines of the dataset at 'path' that start in the byte range [begin, end) into the statistics, by mapping the file
+    into memory and parsing the mapped pages in place, so the text is never copied and only one PointBlock of points is kept at a time.
+    A line belongs to the range it starts in: unless 'begin' is 0 or straight after a '\n', the line it falls in is left to the
+    range before, and the last line that starts before 'end' is finished even if it runs past it. This way a file can be cut
+    anywhere and every line is still parsed exactly once.
+    The file is mapped MAP_WINDOW bytes at a time. Each window is parsed up to its last '\n' and the next window starts at the page
+    holding the first line that was not finished. A last line without a '\n' is copied into a small buffer to add one.
+    Returns 0, 1 if the file can not be opened or has a line that is not an X,Y pair, or -1 if the file can not be mapped
+    (a pipe for example) and has to be read with ReadDataset instead.
+*/
+int MapDataset(const char *path, long long begin, long long end, Statistics *stats)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Files not found. %s\n", path);
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+
+    long long pageSize = sysconf(_SC_PAGESIZE);
+    long long size = info.st_size;
+    if (end > size)
+    {
+        end = size;
+    }
+    // Offset in the file of the first line that has not been parsed yet. Until the end of the line before the range has been
+    // found, it is where to keep looking for that '\n' instead.
+    long long next = (begin > 0) ? begin - 1 : 0;
+    int skipping = (begin > 0);
+    long long rangeStart = begin;
+    long long line = 0;
+    int error = 0;
+    PointBlock *block = PointBlockCreate(stats->Features);
+    while (!error && next < size && next < end)
+    {
+        long long offset = next - next % pageSize;
+        long long length = (size - offset < MAP_WINDOW) ? size - offset : MAP_WINDOW;
+        char *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, offset);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            PointBlockFree(block);
+            // Nothing has been added yet, so the caller can still fall back to reading the file.
+            if (next != 0)
+            {
+                printf("Could not map %s.\n", path);
+                return 1;
+            }
+            return -1;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+        const char *start = map + (next - offset);
+        const char *windowEnd = map + length;
+
+        if (skipping)
+        {
+            const char *newline = memchr(start, '\n', windowEnd - start);
+            if (newline == NULL)
+            {
+                next = offset + length;
+                munmap(map, length);
+                continue;
+            }
+            skipping = 0;
+            start = newline + 1;
+            next = offset + (start - map);
+            rangeStart = next;
+            if (next >= end)
+            {
+                // The line before the range runs past its end, so nothing in it is left to parse.
+                munmap(map, length);
+                break;
+            }
+        }
+
+        // When the range ends in this window, stop after the line holding its last byte, otherwise after the last whole line.
+        const char *stop = NULL;
+        if (next < end && end - offset <= length)
+        {
+            const char *newline = memchr(map + (end - offset) - 1, '\n', windowEnd - (map + (end - offset) - 1));
+            stop = newline ? newline + 1 : NULL;
+        }
+        if (stop == NULL)
+        {
+            stop = windowEnd;
+            while (stop > start && stop[-1] != '\n')
+            {
+                stop--;
+            }
+        }
+
+        if (stop > start)
+        {
+            error = ParseLines(start, stop, block, stats, &line);
+            next = offset + (stop - map);
+        }
+        else if (offset + length == size)
+        {
+            // The last line of the file has no '\n'.
+            size_t rest = windowEnd - start;
+            char *copy = malloc(rest + 1);
+            memcpy(copy, start, rest);
+            copy[rest] = '\n';
+            error = ParseLines(copy, copy + rest + 1, block, stats, &line);
+            free(copy);
+            next = size;
+        }
+        else
+        {
+            // A single line longer than the whole window.
+            error = 1;
+            line++;
+        }
+        munmap(map, length);
+    }
+    PointBlockFlush(block, stats);
+    if (error)
+    {
+        // 'line' counts from the start of the range, so add the lines before it.
+        ReportBadLine(line + (rangeStart > 0 ? CountLines(fd, rangeStart) : 0), path, block->Columns);
+    }
+    PointBlockFree(block);
+    close(fd);
+    return error;
+}
+
+/*
+    Reads the dataset at 'path' into the statistics, "-" reads standard input so the data can come from a pipe or a socket.
+    The input is read in blocks of READ_BLOCK bytes and every line up to the last '\n' in a block is parsed straight from the buffer. Whatever comes after that '\n' is moved to the front and the next block is
+    read in behind it (the buffer grows if a single line does not fit). A last line without a '\n' gets one added at the end.
+    Only the first 'end' bytes are read (LLONG_MAX for all of it), so a file that grows while it is read is parsed up to the size
+    main found for it and no further.
+    Returns 0, or 1 if the file can not be opened or has a line that is not an X,Y pair.
+*/
+int ReadDataset(const char *path, long long end, Statistics *stats)
+{
+    FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+    if (fp == NULL)
+    {
+        printf("Files not found. %s\n", path);
+        return 1;
+    }
+
+    // One spare byte for the '\n' added after a last line that does not have one.
+    size_t capacity = READ_BLOCK;
+    char *buffer = malloc(capacity + 1);
+    size_t kept = 0;
+    long long line = 0;
+    int error = 0;
+    PointBlock *block = PointBlockCreate(stats->Features);
+    long long remaining = end;
+    for (;;)
+    {
+        size_t want = ((long long)(capacity - kept) < remaining) ? capacity - kept : (size_t)remaining;
+        size_t got = fread(buffer + kept, 1, want, fp);
+        remaining -= got;
+        size_t filled = kept + got;
+        if (got == 0 && kept > 0)
+        {
+            buffer[filled++] = '\n';
+        }
+        // Everything up to the last '\n' is complete lines.
+        const char *stop = buffer + filled;
+        while (stop > buffer && stop[-1] != '\n')
+        {
+            stop--;
+        }
+        error = ParseLines(buffer, stop, block, stats, &line);
+        if (error || got == 0)
+        {
+            break;
+        }
+        kept = buffer + filled - stop;
+        memmove(buffer, stop, kept);
+        if (kept == capacity)
+        {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity + 1);
+        }
+    }
+    if (error)
+    {
+        ReportBadLine(line, path, block->Columns);
+    }
+    PointBlockFlush(block, stats);
+    PointBlockFree(block);
+    free(buffer);
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    return error;
+}
+
+// Y = B*X + A for 'count' values of X.
+void PredictLine(const double *X, long long count, double A, double B, double *Y)
+{
+    for (long long i = 0; i < count; i++)
+    {
+        Y[i] = B * X[i] + A;
+    }
+}
+
+// PredictLine four values at a time with AVX2.
+__attribute__((target("avx2"))) void PredictLineAVX2(const double *X, long long count, double A, double B, double *Y)
+{
+    const __m256d a = _mm256_set1_pd(A);
+    const __m256d b = _mm256_set1_pd(B);
+    long long i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm256_storeu_pd(Y + i, _mm256_add_pd(_mm256_mul_pd(b, _mm256_loadu_pd(X + i)), a));
+    }
+    _mm256_zeroupper();
+    PredictLine(X + i, count - i, A, B, Y + i);
+}
+
+/*
+    Writes 'value' like printf("%f\n") would into 'out' and returns the number of characters. For values below 1e9 the value is
+    scaled by 10^6 and rounded to an integer, which is exact as long as the scaled value is not within rounding error of a half,
+    so the six decimals come from integer arithmetic. Anything else goes through snprintf, 'out' must have room for 320 characters.
+*/
+int FormatFixed(double value, char *out)
+{
+    double scaled = fabs(value) * 1e6;
+    double whole = floor(scaled);
+    if (!(fabs(value) < 1e9) || fabs(scaled - whole - 0.5) < 1e-6)
+    {
+        return snprintf(out, 320, "%f\n", value);
+    }
+    uint64_t digits = (uint64_t)whole + (scaled - whole > 0.5);
+    char reversed[24];
+    int n = 0;
+    for (int i = 0; i < 6; i++, digits /= 10)
+    {
+        reversed[n++] = (char)('0' + digits % 10);
+    }
+    reversed[n++] = '.';
+    do
+    {
+        reversed[n++] = (char)('0' + digits % 10);
+        digits /= 10;
+    } while (digits > 0);
+    int length = 0;
+    if (signbit(value))
+    {
+        out[length++] = '-';
+    }
+    while (n > 0)
+    {
+        out[length++] = reversed[--n];
+    }
+    out[length++] = '\n';
+    return length;
+}
+
+/*
+    Batch prediction: reads values of X from 'path' ("-" is standard input), one per line or 'features' comma separated values per
+    line, and writes the predicted Y of every line to standard output, one per line. The input is read in blocks like ReadDataset,
+    a block of POINT_BLOCK lines is predicted at once (with PredictLineAVX2 when the CPU has it) and the text of the whole block
+    is written with one fwrite. Errors go to standard error so they never end up among the predictions.
+    Returns 0, or 1 if the file can not be opened or has a line that is not 'features' numbers.
+*/
+int PredictDataset(const char *path, int features, double A, const double *B)
+{
+    FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Files not found. %s\n", path);
+        return 1;
+    }
+
+    size_t capacity = READ_BLOCK;
+    char *buffer = malloc(capacity + 1);
+    double *rows = malloc((size_t)POINT_BLOCK * features * sizeof(double));
+    double *predicted = malloc(POINT_BLOCK * sizeof(double));
+    // Every prediction is at most a sign, 308 digits, a point, six decimals and a '\n'.
+    char *text = malloc((size_t)POINT_BLOCK * 320);
+    int linear = __builtin_cpu_supports("avx2");
+    int count = 0;
+    size_t kept = 0;
+    long long line = 0;
+    int error = 0;
+    for (;;)
+    {
+        size_t got = fread(buffer + kept, 1, capacity - kept, fp);
+        size_t filled = kept + got;
+        if (got == 0 && kept > 0)
+        {
+            buffer[filled++] = '\n';
+        }
+        const char *stop = buffer + filled;
+        while (stop > buffer && stop[-1] != '\n')
+        {
+            stop--;
+        }
+        const char *start = buffer;
+        for (;;)
+        {
+            // Predict and write out the block when it is full, or when this part of the input is done.
+            if (count == POINT_BLOCK || (count > 0 && (start == stop || error)))
+            {
+                if (features > 1)
+                {
+                    for (int r = 0; r < count; r++)
+                    {
+                        double y = A;
+                        for (int i = 0; i < features; i++)
+                        {
+                            y += B[i] * rows[r * features + i];
+                        }
+                        predicted[r] = y;
+                    }
+                }
+                else if (linear)
+                {
+                    PredictLineAVX2(rows, count, A, B[0], predicted);
+                }
+                else
+                {
+                    PredictLine(rows, count, A, B[0], predicted);
+                }
+                size_t length = 0;
+                for (int r = 0; r < count; r++)
+                {
+                    length += FormatFixed(predicted[r], text + length);
+                }
+                fwrite(text, 1, length, stdout);
+                count = 0;
+            }
+            if (start == stop || error)
+            {
+                break;
+            }
+            int empty = 0;
+            line++;
+            start = ParseRow(start, stop, &rows[(size_t)count * features], features, &empty);
+            if (start == NULL)
+            {
+                error = 1;
+                start = stop;
+                continue;
+            }
+            count += !empty;
+        }
+        if (error || got == 0)
+        {
+            break;
+        }
+        kept = buffer + filled - stop;
+        memmove(buffer, stop, kept);
+        if (kept == capacity)
+        {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity + 1);
+        }
+    }
+    fflush(stdout);
+    if (error)
+    {
+        if (features == 1)
+        {
+            fprintf(stderr, "Line %lld of %s is not a number.\n", line, path);
+        }
+        else
+        {
+            fprintf(stderr, "Line %lld of %s is not %d comma separated numbers.\n", line, path, features);
+        }
+    }
+    free(text);
+    free(predicted);
+    free(rows);
+    free(buffer);
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    return error;
+}
 
 /*
-    This function is used to calculate the values of 'A' and 'B', which are used for linear regression. The variables 'A' and 'B' are pased in as pointers, as
-    are the variables 'SumofX', 'SumofY', 'SumofXY' ,'SumofX2', 'SumofY2, and 'Inputs'.
-    The values 'A' and 'B' are then stored in the memory location pointed to by the pointers 'A' and 'B', respectively.
+    Fit cache (--cache=FILE). For every dataset it keeps the full path, the size, the modification time and an FNV-1a hash of the
+    contents, with the statistics parsed from that file. A later run takes the statistics of a file straight from the cache when
+    its size and time are the same, and when only the time changed (the file was touched or copied) it hashes the file and still
+    takes them if the contents are the same. Only new and changed files are parsed again. The statistics are the means and
+    co-moments, so they merge with the rest exactly as if the file had been parsed.
+    Datasets that grow by lines appended at the end are not parsed again either: 'Offset' is how much of the file the statistics
+    cover, and when the file is longer now, is still the same file (inode) and its first EDGE_WINDOW bytes and the EDGE_WINDOW bytes
+    before 'Offset' are still the same, only the lines after 'Offset' are parsed and merged into the saved statistics. Checking the
+    edges catches a file that was rewritten rather than appended to without reading all of it, an edit in the middle of a file
+    that also grew is not noticed. FNV-1a goes through the bytes in order, so the hash of the whole file carries on from the saved
+    one over the new bytes alone.
+*/
+typedef struct
+{
+    char *Path;
+    long long Size;
+    long long ModifiedSec;
+    long long ModifiedNsec;
+    uint64_t Hash;
+    long long Inode;
+    // -1 when the file did not end with a '\n', its last line could still be growing so the file can only be parsed again.
+    long long Offset;
+    uint64_t EdgeHash;
+    Statistics Stats;
+} CacheEntry;
+
+typedef struct
+{
+    int Features;
+    int Count;
+    CacheEntry *Entries;
+} FitCache;
+
+// "LRC2", the first four bytes of a cache file.
+#define CACHE_MAGIC 0x3243524CU
+// Number of bytes at the start of a file, and before the end of what was parsed, that have to be unchanged for a longer file
+// to count as appended to.
+#define EDGE_WINDOW 4096
+// Starting value of an FNV-1a hash.
+#define FNV_BASIS 14695981039346656037ULL
+
+/*
+    Carries the FNV-1a hash in 'hash' on over the bytes [from, to) of the file at 'path', or up to the end of the file when 'to'
+    is -1. Start 'hash' at FNV_BASIS for a hash of just those bytes. Returns 0, or 1 if the file can not be read.
+*/
+int HashFile(const char *path, long long from, long long to, uint64_t *hash)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 1;
+    }
+    unsigned char *buffer = malloc(READ_BLOCK);
+    uint64_t h = *hash;
+    ssize_t got = 0;
+    while (to < 0 || from < to)
+    {
+        long long want = (to >= 0 && to - from < READ_BLOCK) ? to - from : READ_BLOCK;
+        if ((got = pread(fd, buffer, want, from)) <= 0)
+        {
+            break;
+        }
+        for (ssize_t i = 0; i < got; i++)
+        {
+            h = (h ^ buffer[i]) * 1099511628211ULL;
+        }
+        from += got;
+    }
+    free(buffer);
+    close(fd);
+    *hash = h;
+    return (got < 0 || (to >= 0 && from < to));
+}
+
+// Hash of the first EDGE_WINDOW bytes of the file and the EDGE_WINDOW bytes before 'offset' (no byte twice). Returns 0 or 1 like HashFile.
+int EdgeHash(const char *path, long long offset, uint64_t *hash)
+{
+    long long head = (offset < EDGE_WINDOW) ? offset : EDGE_WINDOW;
+    long long tail = (offset - EDGE_WINDOW > head) ? offset - EDGE_WINDOW : head;
+    *hash = FNV_BASIS;
+    return HashFile(path, 0, head, hash) || HashFile(path, tail, offset, hash);
+}
+
+/*
+    Writes the part of 'stats' that is in use: the count and the five moments of Accumulator for one feature, or the means and
+    the upper triangle of the cross products for more. Reading it back is StatisticsRead, which returns 1 on a short file.
+*/
+void StatisticsWrite(FILE *fp, const Statistics *stats)
+{
+    if (stats->Features == 1)
+    {
+        const Accumulator *acc = &stats->Simple;
+        double moments[5] = {acc->MeanX, acc->MeanY, acc->M2X, acc->M2Y, acc->CXY};
+        fwrite(&acc->Inputs, sizeof(acc->Inputs), 1, fp);
+        fwrite(moments, sizeof(double), 5, fp);
+        return;
+    }
+    const MatrixAccumulator *m = &stats->Multiple;
+    fwrite(&m->Inputs, sizeof(m->Inputs), 1, fp);
+    fwrite(m->Mean, sizeof(double), m->Columns, fp);
+    for (int i = 0; i < m->Columns; i++)
+    {
+        fwrite(&m->Co[i * m->Columns + i], sizeof(double), m->Columns - i, fp);
+    }
+}
+
+int StatisticsRead(FILE *fp, Statistics *stats)
+{
+    if (stats->Features == 1)
+    {
+        Accumulator *acc = &stats->Simple;
+        double moments[5];
+        if (fread(&acc->Inputs, sizeof(acc->Inputs), 1, fp) != 1 || fread(moments, sizeof(double), 5, fp) != 5)
+        {
+            return 1;
+        }
+        acc->MeanX = moments[0];
+        acc->MeanY = moments[1];
+        acc->M2X = moments[2];
+        acc->M2Y = moments[3];
+        acc->CXY = moments[4];
+        return 0;
+    }
+    MatrixAccumulator *m = &stats->Multiple;
+    if (fread(&m->Inputs, sizeof(m->Inputs), 1, fp) != 1 || fread(m->Mean, sizeof(double), m->Columns, fp) != (size_t)m->Columns)
+    {
+        return 1;
+    }
+    for (int i = 0; i < m->Columns; i++)
+    {
+        if (fread(&m->Co[i * m->Columns + i], sizeof(double), m->Columns - i, fp) != (size_t)(m->Columns - i))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+    Loads the cache at 'path'. A missing file, a file from another program or one written for a different --features gives an
+    empty cache, and a file cut short keeps the entries before the cut, so a bad cache only costs parsing the files again.
+*/
+void CacheLoad(const char *path, int features, FitCache *cache)
+{
+    cache->Features = features;
+    cache->Count = 0;
+    cache->Entries = NULL;
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return;
+    }
+    uint32_t header[3];
+    if (fread(header, sizeof(uint32_t), 3, fp) != 3 || header[0] != CACHE_MAGIC || header[1] != (uint32_t)features)
+    {
+        fclose(fp);
+        return;
+    }
+    // The count in the header is not trusted for the allocation, the array grows as entries are actually read from the file.
+    int capacity = 0;
+    for (uint32_t i = 0; i < header[2]; i++)
+    {
+        if (cache->Count == capacity)
+        {
+            int grown = (capacity == 0) ? 16 : capacity * 2;
+            CacheEntry *entries = realloc(cache->Entries, grown * sizeof(CacheEntry));
+            if (entries == NULL)
+            {
+                break;
+            }
+            cache->Entries = entries;
+            capacity = grown;
+        }
+        CacheEntry *entry = &cache->Entries[cache->Count];
+        uint32_t length;
+        long long fields[5];
+        if (fread(&length, sizeof(length), 1, fp) != 1 || length > 65536)
+        {
+            break;
+        }
+        entry->Path = malloc(length + 1);
+        StatisticsInit(&entry->Stats, features);
+        if (entry->Path == NULL || fread(entry->Path, 1, length, fp) != length || fread(fields, sizeof(long long), 5, fp) != 5 ||
+            fread(&entry->Hash, sizeof(entry->Hash), 1, fp) != 1 || fread(&entry->EdgeHash, sizeof(entry->EdgeHash), 1, fp) != 1 ||
+            StatisticsRead(fp, &entry->Stats) != 0)
+        {
+            free(entry->Path);
+            break;
+        }
+        entry->Path[length] = '\0';
+        entry->Size = fields[0];
+        entry->ModifiedSec = fields[1];
+        entry->ModifiedNsec = fields[2];
+        entry->Inode = fields[3];
+        entry->Offset = fields[4];
+        cache->Count++;
+    }
+    fclose(fp);
+}
+
+CacheEntry *CacheFind(FitCache *cache, const char *path)
+{
+    for (int i = 0; i < cache->Count; i++)
+    {
+        if (strcmp(cache->Entries[i].Path, path) == 0)
+        {
+            return &cache->Entries[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+    Puts the statistics of the dataset 'file' (found at the full path 'path') into the cache, replacing what was there for it.
+    'info' and 'hash' describe the file the statistics were parsed from. When it ends with a '\n' the hash of its edges
+    (EdgeHash) is kept too, so the next run can tell whether it has only been appended to.
+*/
+void CacheStore(FitCache *cache, const char *path, const char *file, const struct stat *info, uint64_t hash, const Statistics *stats)
+{
+    CacheEntry *entry = CacheFind(cache, path);
+    if (entry == NULL)
+    {
+        cache->Entries = realloc(cache->Entries, (cache->Count + 1) * sizeof(CacheEntry));
+        entry = &cache->Entries[cache->Count++];
+        entry->Path = strdup(path);
+    }
+    entry->Size = info->st_size;
+    entry->ModifiedSec = info->st_mtim.tv_sec;
+    entry->ModifiedNsec = info->st_mtim.tv_nsec;
+    entry->Hash = hash;
+    entry->Inode = (long long)info->st_ino;
+    entry->Offset = -1;
+    entry->EdgeHash = FNV_BASIS;
+    char last = '\n';
+    int fd = open(file, O_RDONLY);
+    if (fd >= 0 && (info->st_size == 0 || (pread(fd, &last, 1, info->st_size - 1) == 1 && last == '\n')))
+    {
+        entry->Offset = (EdgeHash(file, info->st_size, &entry->EdgeHash) == 0) ? info->st_size : -1;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    entry->Stats = *stats;
+}
+
+// Frees the entries of the cache, loaded or stored.
+void CacheFree(FitCache *cache)
+{
+    for (int i = 0; i < cache->Count; i++)
+    {
+        free(cache->Entries[i].Path);
+    }
+    free(cache->Entries);
+    cache->Entries = NULL;
+    cache->Count = 0;
+}
+
+/*
+    Writes the cache to 'path'. It is written to a temporary file next to it first and renamed over it, so a run that is
+    stopped half way never leaves a cache that is cut short. Returns 0, or 1 if it can not be written.
+*/
+int CacheSave(const char *path, const FitCache *cache)
+{
+    size_t length = strlen(path);
+    char *temporary = malloc(length + 5);
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", 5);
+    FILE *fp = fopen(temporary, "wb");
+    if (fp == NULL)
+    {
+        free(temporary);
+        return 1;
+    }
+    uint32_t header[3] = {CACHE_MAGIC, (uint32_t)cache->Features, (uint32_t)cache->Count};
+    fwrite(header, sizeof(uint32_t), 3, fp);
+    for (int i = 0; i < cache->Count; i++)
+    {
+        const CacheEntry *entry = &cache->Entries[i];
+        uint32_t pathLength = (uint32_t)strlen(entry->Path);
+        long long fields[5] = {entry->Size, entry->ModifiedSec, entry->ModifiedNsec, entry->Inode, entry->Offset};
+        fwrite(&pathLength, sizeof(pathLength), 1, fp);
+        fwrite(entry->Path, 1, pathLength, fp);
+        fwrite(fields, sizeof(long long), 5, fp);
+        fwrite(&entry->Hash, sizeof(entry->Hash), 1, fp);
+        fwrite(&entry->EdgeHash, sizeof(entry->EdgeHash), 1, fp);
+        StatisticsWrite(fp, &entry->Stats);
+    }
+    int error = (fclose(fp) != 0);
+    error = error || rename(temporary, path) != 0;
+    if (error)
+    {
+        remove(temporary);
+    }
+    free(temporary);
+    return error;
+}
+
+/*
+    One piece of work for the parsing threads: the lines of 'Path' that start in [Begin, End), or the whole file when 'Whole' is set.
+    Every task fills its own statistics, and the partial sums are merged in the order of the tasks once all of them are done, so the
+    result does not depend on which thread got which task.
 */
-void FindingLR(double *A, double *B, double *SumofX, double *SumofY, double *SumofXY, double *SumofX2, double *SumofY2, int *Inputs)
+typedef struct
+{
+    const char *Path;
+    // Index of the file in argv, its statistics are kept apart for the fit cache.
+    int File;
+    long long Begin;
+    long long End;
+    int Whole;
+    int Mapped;
+    int Status;
+    Statistics Partial;
+} RangeTask;
+
+// Tasks shared by the parsing threads, each thread takes the next task that nobody has started.
+typedef struct
+{
+    RangeTask *Tasks;
+    int Count;
+    atomic_int Next;
+} TaskQueue;
+
+// Runs one task, its statistics have been set up by main. A whole file that can not be mapped falls back to the buffered reader.
+void RunTask(RangeTask *task)
+{
+    task->Status = task->Mapped ? MapDataset(task->Path, task->Begin, task->End, &task->Partial) : -1;
+    if (task->Status == -1 && !task->Whole)
+    {
+        printf("Could not map %s.\n", task->Path);
+        task->Status = 1;
+    }
+    if (task->Status == -1)
+    {
+        task->Status = ReadDataset(task->Path, task->End, &task->Partial);
+    }
+}
+
+void *ParseWorker(void *param)
 {
-    *A = (*SumofY * *SumofX2 - (*SumofX * *SumofXY)) / (*Inputs * *SumofX2 - *SumofX * *SumofX);
-    *B = (*Inputs * *SumofXY - (*SumofX * *SumofY)) / (*Inputs * *SumofX2 - (*SumofX * *SumofX));
+    TaskQueue *queue = (TaskQueue *)param;
+    for (;;)
+    {
+        int i = atomic_fetch_add(&queue->Next, 1);
+        if (i >= queue->Count)
+        {
+            break;
+        }
+        // Standard input is read by the main thread.
+        if (strcmp(queue->Tasks[i].Path, "-") != 0)
+        {
+            RunTask(&queue->Tasks[i]);
+        }
+    }
+    return NULL;
 }
 
 int main(int argc, char *argv[])
 {
     // Variables used for calculating Linear Regression
-    double SumofX = 0;
-    double SumofY = 0;
-    double SumofXY = 0;
-    double SumofX2 = 0;
-    double SumofY2 = 0;
-    int Inputs = 0;
-    int Length = 0;
     double A = 0;
     double B = 0;
 
-    //------ Used for loops. --------
-    int i = 0;
-    int j = 0;
-    int k = 0;
+    // Every file is mapped and parsed in place, a file that can not be mapped (or every file with --no-mmap) goes through the
+    // buffered reader. Files are shared out between --threads=N threads, and a big mapped file is cut into ranges so a single
+    // file keeps all of them busy.
+    int useMap = 1;
+    int readStdin = 0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int features = 1;
+    const char *predictPath = NULL;
+    const char *cachePath = NULL;
+    // Every option is checked here, so anything else starting with "--" (a typo such as --thread=4, or --predict without a
+    // file) stops the run instead of being taken for a dataset or ignored. The loops below skip the options by their "--".
+    for (int i = 1; i < argc; i++)
+    {
+        char *end = NULL;
+        if (strcmp(argv[i], "--no-mmap") == 0)
+        {
+            useMap = 0;
+        }
+        else if (strncmp(argv[i], "--features=", 11) == 0)
+        {
+            long value = strtol(argv[i] + 11, &end, 10);
+            if (end == argv[i] + 11 || *end != '\0' || value < 1 || value > MAX_FEATURES)
+            {
+                printf("--features must be between 1 and %d.\n", MAX_FEATURES);
+                return 1;
+            }
+            features = (int)value;
+        }
+        else if (strncmp(argv[i], "--cache=", 8) == 0)
+        {
+            cachePath = argv[i] + 8;
+            if (*cachePath == '\0')
+            {
+                printf("--cache takes the file the statistics are kept in.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--predict=", 10) == 0)
+        {
+            predictPath = argv[i] + 10;
+            if (*predictPath == '\0')
+            {
+                printf("--predict takes a file of X values, or - for standard input.\n");
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            long value = strtol(argv[i] + 10, &end, 10);
+            if (end == argv[i] + 10 || *end != '\0' || value < 1 || value > INT_MAX)
+            {
+                printf("--threads takes a number of threads such as 4.\n");
+                return 1;
+            }
+            threads = (int)value;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0)
+        {
+            printf("Unknown option %s\n", argv[i]);
+            printf("Usage: ./LinearRegression [--threads=N] [--features=K] [--no-mmap] [--cache=FILE] [--predict=FILE] FILE...\n");
+            return 1;
+        }
+        readStdin |= (strcmp(argv[i], "-") == 0);
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (predictPath != NULL && readStdin && strcmp(predictPath, "-") == 0)
+    {
+        printf("Standard input can not hold both the dataset and the values to predict.\n");
+        return 1;
+    }
 
-    FILE *fp;
-    char *temparrayinstring = (char *)calloc(1, sizeof(char));
+    // The statistics of every file on its own, filled from the cache or by the tasks that parse it.
+    FitCache cache = {features, 0, NULL};
+    if (cachePath != NULL)
+    {
+        CacheLoad(cachePath, features, &cache);
+    }
+    Statistics *files = malloc(argc * sizeof(Statistics));
+    struct stat *infos = calloc(argc, sizeof(struct stat));
+    char **realPaths = calloc(argc, sizeof(char *));
+    uint64_t *hashes = calloc(argc, sizeof(uint64_t));
+    int *hashed = calloc(argc, sizeof(int));
+    int *reused = calloc(argc, sizeof(int));
+    // Where parsing starts in every file, after the part the cache already has for a file that has been appended to.
+    long long *starts = calloc(argc, sizeof(long long));
 
-    /*
-        This loop the program will attempt to open the file specified by 'argv[i]' in read only mode.
-        If the file cannot be opened as stated in the if condition, an error message is printed and
-        the program returns 1. If the file can be opened, the file pointer 'fp' is set to the open file,
-        and the file's length is calculated and added to the 'Length' variable.
-    */
-    for (i = 1; i < argc; i++)
+    // Find the size of every file first, the ranges are cut so there are about four for each thread. Files the cache already
+    // has are not parsed and do not count.
+    long long *sizes = calloc(argc, sizeof(long long));
+    long long totalBytes = 0;
+    for (int i = 1; i < argc; i++)
     {
-        // If program didn't find any files with the mentioned name.
-        if ((fp = fopen(argv[i], "r")) == NULL)
+        if (strncmp(argv[i], "--", 2) == 0)
+        {
+            continue;
+        }
+        StatisticsInit(&files[i], features);
+        if (strcmp(argv[i], "-") == 0)
+        {
+            continue;
+        }
+        if (stat(argv[i], &infos[i]) != 0)
         {
             printf("Files not found. %s\n", argv[i]);
             return 1;
         }
-        else
+        if (!S_ISREG(infos[i].st_mode))
         {
-            fp = fopen(argv[i], "r");
-            fseek(fp, 0, SEEK_END);
-            Length += ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-
-            temparrayinstring = realloc(temparrayinstring, Length * sizeof(char));
-            char chartoarray;
-
-            /*
-                This section of the program reads each character from the file, one at a time, using the 'fgetc'
-                function, until the end of the file is reaches(indicated by the 'EOF'(accronym for 'End of File')).
-                If the character read is a newline character \n, the 'Inputs' variable is incremented. The character
-                is then added to the 'temparrayinstring' array.
-            */
-            for (j = 0; (chartoarray = fgetc(fp)) != EOF; j++)
+            continue;
+        }
+        if (cachePath != NULL && (realPaths[i] = realpath(argv[i], NULL)) != NULL)
+        {
+            CacheEntry *entry = CacheFind(&cache, realPaths[i]);
+            if (entry != NULL && entry->Size == infos[i].st_size)
+            {
+                if (entry->ModifiedSec == infos[i].st_mtim.tv_sec && entry->ModifiedNsec == infos[i].st_mtim.tv_nsec)
+                {
+                    reused[i] = 1;
+                }
+                else
+                {
+                    hashes[i] = FNV_BASIS;
+                    hashed[i] = (HashFile(argv[i], 0, -1, &hashes[i]) == 0);
+                    reused[i] = hashed[i] && (hashes[i] == entry->Hash);
+                }
+            }
+            else if (entry != NULL && useMap && entry->Offset >= 0 && entry->Offset == entry->Size && infos[i].st_size > entry->Size &&
+                     entry->Inode == (long long)infos[i].st_ino)
             {
-                if (chartoarray == '\n')
+                uint64_t edges;
+                if (EdgeHash(argv[i], entry->Offset, &edges) == 0 && edges == entry->EdgeHash)
                 {
-                    Inputs += +1;
+                    // Only new lines at the end, parse from the saved offset on top of the saved statistics.
+                    files[i] = entry->Stats;
+                    starts[i] = entry->Offset;
+                    hashes[i] = entry->Hash;
                 }
-                temparrayinstring[k] = chartoarray;
-                k++;
-                // printf("%c\n", chartoarray); <-- To check if program is reading all the characters.
+            }
+            if (reused[i])
+            {
+                files[i] = entry->Stats;
+                continue;
             }
         }
+        sizes[i] = infos[i].st_size;
+        totalBytes += useMap ? sizes[i] - starts[i] : 0;
+    }
+    long long rangeSize = totalBytes / ((long long)threads * 4);
+    if (rangeSize < RANGE_MIN)
+    {
+        rangeSize = RANGE_MIN;
     }
-    // Closes fp.
-    fclose(fp);
 
-    // String Token will be used to remove unwanted charachters such as , and \n.
-    char delim[] = ",\n";
-    char *ptr = strtok(temparrayinstring, delim);
+    // Make the tasks in the order of the files, so the merge below adds the files up in the order they were listed.
+    int taskCount = 0;
+    int taskCapacity = argc;
+    RangeTask *tasks = malloc(taskCapacity * sizeof(RangeTask));
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) == 0 || reused[i])
+        {
+            continue;
+        }
+        // A file read with the buffered reader is one task, only a mapped file is cut into ranges.
+        long long step = useMap ? rangeSize : LLONG_MAX;
+        long long begin = starts[i];
+        do
+        {
+            if (taskCount == taskCapacity)
+            {
+                taskCapacity *= 2;
+                tasks = realloc(tasks, taskCapacity * sizeof(RangeTask));
+            }
+            RangeTask *task = &tasks[taskCount++];
+            task->Path = argv[i];
+            task->File = i;
+            task->Begin = begin;
+            task->End = (sizes[i] - begin > step) ? begin + step : sizes[i];
+            task->Whole = (begin == 0 && task->End == sizes[i]);
+            task->Mapped = useMap && strcmp(argv[i], "-") != 0;
+            task->Status = 0;
+            StatisticsInit(&task->Partial, features);
+            // A file that could not be sized (a pipe or a device) is one task that reads until the end. A regular file is only
+            // parsed up to the size it had when it was looked at, which is also the size the fit cache records for it, so lines
+            // appended while it is being parsed are left for the next run.
+            if (!S_ISREG(infos[i].st_mode))
+            {
+                task->End = LLONG_MAX;
+            }
+            begin = task->End;
+        } while (begin < sizes[i]);
+    }
 
-    // Since int takes 4 bytes a new int array is created with 4*
-    int *arrayofint = calloc((Length * 4), sizeof(int));
+    TaskQueue queue;
+    queue.Tasks = tasks;
+    queue.Count = taskCount;
+    atomic_init(&queue.Next, 0);
+    if (threads > taskCount)
+    {
+        threads = taskCount;
+    }
+    pthread_t *workers = malloc((threads > 0 ? threads : 1) * sizeof(pthread_t));
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, ParseWorker, &queue);
+    }
+    for (int i = 0; i < taskCount; i++)
+    {
+        if (strcmp(tasks[i].Path, "-") == 0)
+        {
+            RunTask(&tasks[i]);
+        }
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
 
-    // Reset i to 0 for re-usability.
-    i = 0;
-    while (ptr != NULL)
+    int failed = 0;
+    for (int i = 0; i < taskCount; i++)
+    {
+        failed |= tasks[i].Status;
+        StatisticsMerge(&files[tasks[i].File], &tasks[i].Partial);
+    }
+    Statistics all;
+    StatisticsInit(&all, features);
+    for (int i = 1; i < argc; i++)
     {
-        // printf("%s\n", ptr);<-- is used to double check if the temparrayinstring[] has indeed aquired all X-axis and Y-axis form each file.
-        arrayofint[i] = atoi(ptr);
-        ptr = strtok(NULL, delim);
-        i++;
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            StatisticsMerge(&all, &files[i]);
+        }
     }
 
-    // Main argorithm to allocate data to: Sum of X, Sum of Y, Sum of XY, Sumof X^2 and Sum of Y^2.
-    for (i = 0; i < (Inputs * 2); i++)
+    // Put every file that was parsed into the cache (and the new times of files that were only touched) for the next run.
+    if (cachePath != NULL && !failed)
     {
-        int temp = 0;
-        int XYtemp[2];
-        if (i % 2 == 0)
+        for (int i = 1; i < argc; i++)
         {
-            SumofX += (double)arrayofint[i];
-            temp = (double)arrayofint[i];
-            SumofX2 += temp * temp;
+            if (realPaths[i] == NULL)
+            {
+                continue;
+            }
+            if (!hashed[i] && !reused[i])
+            {
+                // An appended file carries on from the saved hash over the new bytes, any other file is hashed from the start.
+                if (starts[i] == 0)
+                {
+                    hashes[i] = FNV_BASIS;
+                }
+                hashed[i] = (HashFile(argv[i], starts[i], infos[i].st_size, &hashes[i]) == 0);
+            }
+            if (hashed[i])
+            {
+                CacheStore(&cache, realPaths[i], argv[i], &infos[i], hashes[i], &files[i]);
+            }
         }
-        else
+        if (CacheSave(cachePath, &cache) != 0)
         {
-            SumofY += (double)arrayofint[i];
-            temp = (double)arrayofint[i];
-            SumofY2 += temp * temp;
+            printf("Could not write the cache %s.\n", cachePath);
+        }
+    }
+    Accumulator total = all.Simple;
+    MatrixAccumulator *matrix = &all.Multiple;
+    CacheFree(&cache);
+    for (int i = 1; i < argc; i++)
+    {
+        free(realPaths[i]);
+    }
+    free(workers);
+    free(tasks);
+    free(sizes);
+    free(files);
+    free(infos);
+    free(realPaths);
+    free(hashes);
+    free(hashed);
+    free(reused);
+    free(starts);
+    if (failed)
+    {
+        return 1;
+    }
 
-            SumofXY += (arrayofint[i - 1] * arrayofint[i]);
+    if (features > 1)
+    {
+        // y = a + b1*x1 + ... + bK*xK, read the K values of X from the user the same way as below.
+        double coefficients[MAX_FEATURES];
+        if (MatrixFit(matrix, &A, coefficients) != 0)
+        {
+            printf("More lines than features are needed, and no feature can be constant or a mix of the others.\n");
+            return 1;
+        }
+        if (predictPath != NULL)
+        {
+            return PredictDataset(predictPath, features, A, coefficients);
+        }
+        printf("Using the equation y=a+b1*x1+...+b%d*x%d. \nFrom the data aquired we have A as %f", features, features, A);
+        for (int i = 0; i < features; i++)
+        {
+            printf(" B%d as %f", i + 1, coefficients[i]);
+        }
+        printf("\n");
+        if (readStdin)
+        {
+            return 0;
+        }
+        printf("Enter X1 to X%d:", features);
+        double predicted = A;
+        for (int i = 0; i < features; i++)
+        {
+            double x = 0;
+            if (scanf("%lf", &x) != 1)
+            {
+                printf("\n");
+                return 0;
+            }
+            predicted += coefficients[i] * x;
         }
+        printf("\nThe predicted Y is :%f\n", predicted);
+        return 0;
+    }
+
+    // Send the sums to FindingLR through the accumulator.
+    if (AccumulatorFit(&total, &A, &B) != 0)
+    {
+        printf("At least two points with different X values are needed for a linear regression.\n");
+        return 1;
+    }
+    // With --predict the output is only the predictions, one per line, so it can be piped straight into the next job.
+    if (predictPath != NULL)
+    {
+        return PredictDataset(predictPath, 1, A, &B);
     }
-    // Send the variables by reference and manipulate the data by using the method: FindingLR in line 10.
-    FindingLR(&A, &B, &SumofX, &SumofY, &SumofXY, &SumofX2, &SumofY2, &Inputs);
 
     // Testing Data and comparing it with the excel data.
 
     // printf("\nA is: %f", A);
     // printf("B is: %f", B);
-    // printf("Inputs :%d\n", Inputs);
-    // printf("SumofX %f\n", SumofX);
-    // printf("SumofY %f\n", SumofY);
-    // printf("SumofXY %f\n", SumofXY);
-    // printf("SumofX2 %f\n", SumofX2);
-    // printf("SumofY2 %f\n", SumofY2);
+    // printf("Inputs :%lld\n", total.Inputs);
+    // printf("MeanX %f\n", total.MeanX);
+    // printf("MeanY %f\n", total.MeanY);
+    // printf("M2X %f\n", total.M2X);
+    // printf("M2Y %f\n", total.M2Y);
+    // printf("CXY %f\n", total.CXY);
 
     // Use y=bx+a (aka. y=mx+c) to aquire the Predicted Y.
     double WhatisY = 0;
-    printf("Using the equation y=bx+a. \nFrom the data aquired we have A as %f and B as %f\nEnter X:", A, B);
-    scanf("%lf", &WhatisY);
+    printf("Using the equation y=bx+a. \nFrom the data aquired we have A as %f and B as %f\n", A, B);
+    // When the data came in through standard input there is nothing left there to read X from.
+    if (readStdin)
+    {
+        return 0;
+    }
+    printf("Enter X:");
+    if (scanf("%lf", &WhatisY) != 1)
+    {
+        printf("\n");
+        return 0;
+    }
     printf("\nY = (%f * %.2f) + %f\n", B, WhatisY, A);
     printf("The predicted Y is :%f\n", (B * WhatisY) + A);
-
-    // Freeing allocated memory.
-    free(temparrayinstring);
-    free(arrayofint);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,3 +1,3 @@
 #!/bin/bash
 
-gcc LinearRegression.c -o LinearRegression;./LinearRegression datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; rm LinearRegression;
\ No newline at end of file
+gcc LinearRegression.c -o LinearRegression -pthread -lm;./LinearRegression datasetLR1.txt datasetLR2.txt datasetLR3.txt datasetLR4.txt; rm LinearRegression;
\ No newline at end of file
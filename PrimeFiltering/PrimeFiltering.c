@@ -6,15 +6,24 @@
     the prime numbers and writes them to output file. The program then prints the total
     number of prime numbers found.
 
+    The threads can be pinned to CPUs with --affinity=compact (fill one socket first), --affinity=scatter
+    (spread over the sockets) or a list such as --affinity=0,2,8-11. Each thread copies its batch of numbers
+    into memory it allocates itself, so on a multi-socket machine the batch sits next to the CPU filtering it.
+
     run the program using this command:
         gcc PrimeFiltering.c -pthread -o PrimeFiltering;
         ./PrimeFiltering.c 3 PrimeData1.txt PrimeData2.txt PrimeData3.txt;
+        ./PrimeFiltering 3 --affinity=scatter PrimeData1.txt PrimeData2.txt;
         rm PrimeFiltering
 */
 
+// For sched_getaffinity and pthread_attr_setaffinity_np.
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <sched.h>
 
 // Defines a struct to hold the parameters for the threads.
 typedef struct
@@ -29,6 +38,135 @@ typedef struct
 
 } Parameter;
 
+// Returns the socket (physical package) of a cpu from sysfs, or 0 if it can't be read.
+int cpu_socket(int cpu)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *file = fopen(path, "r");
+    int socket = 0;
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &socket) != 1)
+        {
+            socket = 0;
+        }
+        fclose(file);
+    }
+    return socket;
+}
+
+/*
+    Fills 'cpus' with the cpu each thread gets pinned to for --affinity, thread i runs on cpus[i % count].
+    "compact" uses every cpu of one socket before the next one, "scatter" takes one cpu from each socket in turn
+    and a list such as "0,2,8-11" is used as it is. Returns the number of cpus, or -1 if the text is not valid
+    or names a cpu this process isn't allowed to run on.
+*/
+int affinity_plan(const char *mode, int *cpus, int max)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return -1;
+    }
+    int count = 0;
+
+    if (strcmp(mode, "compact") == 0 || strcmp(mode, "scatter") == 0)
+    {
+        int socket[CPU_SETSIZE];
+        int rank[CPU_SETSIZE];
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus[count] = cpu;
+                socket[count] = cpu_socket(cpu);
+                // The rank is how many cpus of the same socket come before this one.
+                rank[count] = 0;
+                for (int j = 0; j < count; j++)
+                {
+                    rank[count] += socket[j] == socket[count];
+                }
+                count++;
+            }
+        }
+        // Insertion sort by socket (compact) or by rank then socket (scatter), keeping the cpu order for ties.
+        int scatter = strcmp(mode, "scatter") == 0;
+        for (int i = 1; i < count; i++)
+        {
+            int cpu = cpus[i];
+            int s = socket[i];
+            int r = rank[i];
+            int j = i - 1;
+            while (j >= 0 && (scatter ? (rank[j] > r || (rank[j] == r && socket[j] > s)) : socket[j] > s))
+            {
+                cpus[j + 1] = cpus[j];
+                socket[j + 1] = socket[j];
+                rank[j + 1] = rank[j];
+                j--;
+            }
+            cpus[j + 1] = cpu;
+            socket[j + 1] = s;
+            rank[j + 1] = r;
+        }
+        return count;
+    }
+
+    // Explicit list of cpus and ranges.
+    const char *text = mode;
+    while (*text != '\0')
+    {
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+        if (end == text || first < 0)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || last < first)
+            {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            if (count == max || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+            {
+                return -1;
+            }
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end != '\0')
+        {
+            return -1;
+        }
+        text = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+// Sets up the thread attributes so thread 'index' starts on its cpu. With no cpus the defaults are kept.
+void affinity_attr(pthread_attr_t *attr, const int *cpus, int count, int index)
+{
+    pthread_attr_init(attr);
+    if (count > 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[index % count], &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+}
+
 // Function for filtering prime numbers in a given batch.
 // Once a number is identified as Prime it'll be outputted in the FilteredPrimeNumbers.txt file.
 void *is_prime(void *p)
@@ -37,11 +175,14 @@ void *is_prime(void *p)
     Parameter *param = (Parameter *)p;
     // Initialize a variable to store wheter or not current number is prime.
     int was_it_prime = 0;
+    // Copy the batch into memory this thread allocates and touches first, so it is placed on the socket of the cpu running it.
+    int *batch_numbers = (int *)malloc((param->end - param->start) * sizeof(int));
+    memcpy(batch_numbers, param->array + param->start, (param->end - param->start) * sizeof(int));
     // Loop through the nubers in the current batch
     for (int i = param->start; i < param->end; i++)
     {
         // Store the current number in the current batch.
-        int number = param->array[i];
+        int number = batch_numbers[i - param->start];
         // Check if the number in  seperate variable.
         if (number <= 1)
         {
@@ -73,9 +214,11 @@ void *is_prime(void *p)
         // Write the prime number to the file if it is prime.
         if (param->isPrime[i] == 1)
         {
-            fprintf(param->output_file, "%d\n", param->array[i]);
+            fprintf(param->output_file, "%d\n", number);
         }
     }
+    free(batch_numbers);
+    return NULL;
 }
 
 int main(int argc, char *argv[])
@@ -85,6 +228,22 @@ int main(int argc, char *argv[])
 
     int batches = atoi(argv[1]);
 
+    // Optional --affinity argument, it can go anywhere after the number of threads.
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--affinity=", 11) == 0)
+        {
+            cpu_count = affinity_plan(argv[i] + 11, cpus, CPU_SETSIZE);
+            if (cpu_count <= 0)
+            {
+                printf("--affinity takes compact, scatter or a list of cpus this process can use such as 0,2,8-11\n");
+                return 1;
+            }
+        }
+    }
+
     FILE *output_file = fopen("FilteredPrimeNumbers.txt", "w");
 
     // Check if the FilteredPrimeNumbers.txt failed to be created.
@@ -110,6 +269,11 @@ int main(int argc, char *argv[])
     // Loop through each input file
     for (int i = 2; i < argc; i++)
     {
+        // Skip the --affinity option.
+        if (strncmp(argv[i], "--affinity=", 11) == 0)
+        {
+            continue;
+        }
 
         // Open the input file
         FILE *input_file = fopen(argv[i], "r");
@@ -187,8 +351,11 @@ int main(int argc, char *argv[])
             param[i].isPrime = prime_filter_placeholder;
             param[i].output_file = output_file;
 
-            // Creates the thread.
-            pthread_create(threads + index, NULL, is_prime, (void *)&param[index]);
+            // Creates the thread, pinned to its cpu if --affinity was given.
+            pthread_attr_t attr;
+            affinity_attr(&attr, cpus, cpu_count, index);
+            pthread_create(threads + index, &attr, is_prime, (void *)&param[index]);
+            pthread_attr_destroy(&attr);
             index++;
 
             // Update start row for next batch